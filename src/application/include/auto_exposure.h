@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Auto exposure
+ *
+ * Level of the frame is the ADU value at given percentile of its histogram
+ * (50 is median). Sensor is linear, so exposure x gain which gives target
+ * level is found in one step from the level of a frame and the exposure and
+ * gain it was taken with. Step is limited to AE_MAX_STEP both ways, frames
+ * clipped at the percentile only give the direction.
+ *
+ * Gain is assumed linear, signal is proportional to AE_GAIN_UNITY + gain.
+ * Exposure is raised first, gain only above max_exposure.
+ */
+
+#define AE_GAIN_UNITY       32U
+#define AE_GAIN_MAX         255U
+#define AE_MAX_STEP         8U
+#define AE_MIN_EXPOSURE     10U         // us
+#define AE_MAX_EXPOSURE     1000000U    // us, longer exposures are set manually
+#define AE_TOLERANCE        16U         // level within target/16 is kept
+
+struct auto_exposure_s {
+    uint16_t target;        // ADU
+    uint8_t percentile;     // 0..100
+    bool auto_gain;         // gain is changed too, otherwise exposure only
+    uint64_t max_exposure;  // us
+};
+
+/* ADU value below which percentile of pixels are, 0..0xFFFF */
+uint32_t auto_exposure_level(const uint32_t *histogram, unsigned bins, uint32_t pixels, unsigned percentile);
+
+/*
+ * New exposure and gain from the level of a frame taken with them.
+ * Returns false when they are kept
+ */
+bool auto_exposure_update(const struct auto_exposure_s *ae, uint32_t level, uint64_t *exposure, unsigned *gain);
@@ -6,6 +6,9 @@ struct config_s {
     uint16_t width;
     uint16_t height;
     char FourCC[4];
+    char FourCC_Y12P[4];    // packed 12 bit format
+    char FourCC_Y10P[4];    // packed 10 bit format
+    char FourCC_Rice[4];    // Rice compressed Y16 format
 };
 
 extern struct config_s camera_config;
@@ -3,9 +3,29 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/* Per stage times, TIMESTAMP_FREQ units */
+struct core_stage_timing_s {
+    uint32_t last;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t count;
+};
+
+struct core_timing_s {
+    struct core_stage_timing_s exposure;
+    struct core_stage_timing_s readout;
+    struct core_stage_timing_s upload;      // slot held by USB
+    struct core_stage_timing_s dead;        // end of exposure to start of next one
+    uint32_t frames;
+    uint32_t slot_waits;                    // exposure delayed, no free slot
+};
+
 void core_init(struct usb_context_s *ctx);
 
 void core_sensors_poll_function(void *ctx);
+void core_exposure_function(void *ctx);
+void core_get_timing(struct core_timing_s *timing);
 
 void core_read_ccd_completed_cb(void);
 
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "system_config.h"
+
+/*
+ * Hot pixel defect map
+ *
+ * Defects are kept in EEPROM after the config, sorted by row and column:
+ * big endian count, then big endian x, y of each defect. frame_reader
+ * replaces each defect with the mean of its left and right neighbours
+ * before statistics, packing and compression, so host gets clean frames.
+ *
+ * Ranges come in frame order, a cursor follows them forward, so the cost
+ * of a range is the number of defects inside it. A range before the
+ * cursor (next frame, read again) finds its place by binary search.
+ */
+
+#define DEFECT_MAP_EEPROM_ADDR  0x40U
+#define DEFECT_MAP_MAX          ((I2C_EEPROM_SIZE - DEFECT_MAP_EEPROM_ADDR - 2U) / 4U)
+
+void defect_map_load(uint16_t width, uint16_t height);
+
+/* Edit the map and store it to EEPROM, called from task */
+int defect_map_add(uint16_t x, uint16_t y);
+int defect_map_remove(uint16_t x, uint16_t y);
+int defect_map_clear(void);
+
+unsigned defect_map_count(void);
+int defect_map_get(unsigned index, uint16_t *x, uint16_t *y);
+
+/*
+ * Correct n unbinned Y16 pixels starting at pixel offset of the frame,
+ * called from QSPI DMA interrupt. Neighbours outside of the range are
+ * not known, edge defects take the one inside
+ */
+void defect_map_apply(uint32_t offset, uint16_t *pixels, size_t n);
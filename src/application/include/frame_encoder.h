@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "usbd_conf.h"
+#include "hw/quadspi.h"
+
+/*
+ * Lossless Rice compressed Y16 format
+ *
+ * Rows are coded one after another, each row is padded with zero bits
+ * to a byte boundary. Bits are written MSB first.
+ *
+ * Pixel 0 of a row is predicted by pixel 0 of the previous row (0 for the
+ * first row), other pixels by their left neighbour. Residual is taken
+ * modulo 2^16 as signed and zigzag mapped: u = (d << 1) ^ (d >> 15).
+ *
+ * Row is split into blocks of FRAME_ENCODER_BLOCK pixels (the last one
+ * may be shorter), each starts with 4 bit parameter k:
+ *   k < 15  - each u is q = u >> k as q one bits and a zero bit, then
+ *             k low bits of u. When q >= FRAME_ENCODER_ESCAPE, it is
+ *             FRAME_ENCODER_ESCAPE one bits and 16 bits of u instead.
+ *   k = 15  - each u is 16 bits as is
+ *
+ * utils/ricedec.py is the host decoder.
+ */
+
+#define FRAME_ENCODER_BLOCK CAMERA_UVC_RICE_BLOCK
+#define FRAME_ENCODER_ESCAPE 16U
+#define FRAME_ENCODER_RAW 15U
+
+/* Largest coded row, see UVC_RICE_FRAME_SIZE */
+#define FRAME_ENCODER_ROW_MAX(w) ((w) * 2U + ((w) + 2U * FRAME_ENCODER_BLOCK - 1U) / (2U * FRAME_ENCODER_BLOCK))
+
+typedef void (*FRAME_ENCODER_Callback)(bool ok, size_t len, bool eof);
+
+/* Code one row, prev_first keeps pixel 0 of the previous row. Returns coded bytes */
+size_t frame_encoder_encode_row(uint8_t *dst, const uint16_t *row, unsigned width, uint16_t *prev_first);
+
+/*
+ * Fill buf with up to len bytes of the coded frame, starting at offset.
+ * Offset 0 starts a new frame, other offsets continue from the previous
+ * request. Rows are read with frame_reader, so binning applies.
+ */
+HAL_StatusTypeDef frame_encoder_read(uint32_t address, uint32_t offset, uint8_t *buf, size_t len, FRAME_ENCODER_Callback cb);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum frame_slot_state_e {
+    FRAME_SLOT_FREE = 0,
+    FRAME_SLOT_WRITING,     // readout is writing frame into slot
+    FRAME_SLOT_READY,       // frame is queued for USB
+    FRAME_SLOT_READING,     // frame is being sent
+};
+
+struct frame_slot_s {
+    uint32_t address;       // SRAM address of the frame
+    uint32_t sequence;      // number of exposure
+    uint64_t exposure;      // us
+    uint32_t gain;
+    uint32_t temperature;   // 0.1 K units
+    uint32_t window_temperature;
+    uint32_t target_temperature;
+    uint32_t pts;           // exposure start, TIMESTAMP_FREQ units
+    uint32_t end;           // exposure end, TIMESTAMP_FREQ units
+    uint8_t flags;          // FRAME_METADATA_* bits
+    uint8_t window_heater;
+    uint8_t trigger_mode;
+    enum frame_slot_state_e state;
+    bool valid;             // holds a complete frame, also when it is free again
+    uint8_t pins;           // resends of the frame, slot is not written while pinned
+};
+
+struct frame_queue_stats_s {
+    unsigned slots;
+    unsigned queued;        // slots READY
+    uint32_t dropped;       // queued frames overwritten because no slot was free
+};
+
+/* Split first size bytes of SRAM into slots for frames of width x height Y16 pixels */
+int frame_queue_init(uint16_t width, uint16_t height, uint32_t size);
+
+/*
+ * Producer side. When all slots are taken, the oldest queued frame is
+ * dropped, so an exposure is never lost for a slow host.
+ * Returns NULL only when every slot is being written or sent.
+ */
+struct frame_slot_s *frame_queue_acquire_write(void);
+void frame_queue_commit_write(struct frame_slot_s *slot);
+void frame_queue_abort_write(struct frame_slot_s *slot);
+
+/* Consumer side, oldest queued frame first. Returns NULL when queue is empty */
+struct frame_slot_s *frame_queue_acquire_read(void);
+/* Take given queued slot out of order, for still image. Returns false when it is not queued */
+bool frame_queue_acquire_read_slot(struct frame_slot_s *slot);
+void frame_queue_release_read(struct frame_slot_s *slot);
+
+/*
+ * Pin the frame with given sequence for a resend, whatever state its slot
+ * is in, unless it is being overwritten. Returns NULL when it is gone
+ */
+struct frame_slot_s *frame_queue_pin(uint32_t sequence);
+void frame_queue_unpin(struct frame_slot_s *slot);
+
+void frame_queue_get_stats(struct frame_queue_stats_s *stats);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "hw/quadspi.h"
+
+void frame_reader_init(uint16_t width, uint16_t height);
+int frame_reader_set_binning(unsigned binning);
+int frame_reader_set_packing(unsigned bits);
+
+/* Size of the output frame in pixels */
+void frame_reader_get_size(uint16_t *width, uint16_t *height);
+
+/* Output frame is the frame in SRAM as is: no binning, Y16 */
+bool frame_reader_is_direct(void);
+
+HAL_StatusTypeDef frame_reader_read(uint32_t address, uint32_t offset, uint8_t *buf, size_t len, QUADSPI_ReadCallback cb);
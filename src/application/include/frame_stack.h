@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "frame_queue.h"
+
+/*
+ * Frame stacking
+ *
+ * depth readouts are summed into a 32-bit accumulator frame kept at the
+ * end of SRAM, after the frame queue slots, along with per pixel min and
+ * max frames for rejection. Only the stack is sent: the slot of its last
+ * readout gets (sum - min - max) >> shift saturated to Y16 and is queued
+ * as an ordinary frame, with PTS of the first readout and exposure of
+ * all of them.
+ *
+ * Readouts are read and the accumulator is updated by QSPI from the
+ * exposure task, FRAME_STACK_BLOCK pixels at a time.
+ */
+
+#define FRAME_STACK_BLOCK 512U
+
+/* Returns size of SRAM at its end taken by the accumulator */
+uint32_t frame_stack_init(uint16_t width, uint16_t height);
+
+/* Called from USB interrupt, stack in progress is restarted */
+int frame_stack_set(unsigned depth, unsigned flags, unsigned shift);
+void frame_stack_get(unsigned *depth, unsigned *flags, unsigned *shift);
+bool frame_stack_active(void);
+
+/*
+ * Add readout in slot to the stack. Returns true when the stack is
+ * complete and written to the slot, which is to be queued then
+ */
+bool frame_stack_add(struct frame_slot_s *slot);
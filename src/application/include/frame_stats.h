@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "usbd_conf.h"
+#include "frame_queue.h"
+
+/*
+ * Statistics of the streamed frame
+ *
+ * Y16 pixels are counted as frame_reader produces them for USB, after
+ * binning and before packing or compression, so no extra SRAM reads are
+ * needed. Pixels must come in order, ranges which are read again are
+ * skipped. Statistics are published when the last pixel is counted.
+ *
+ * Histogram bin is the high byte of the pixel.
+ */
+
+#define FRAME_STATS_BINS CAMERA_STATS_BINS
+#define FRAME_STATS_SATURATION 0xFFFFU
+
+struct frame_stats_s {
+    uint32_t sequence;      // frame_slot_s sequence of the frame
+    uint64_t exposure;      // us, the frame was taken with
+    uint32_t gain;
+    uint32_t pixels;        // 0 when no frame is completed yet
+    uint16_t min;
+    uint16_t max;
+    uint16_t mean;
+    uint32_t saturated;     // pixels >= FRAME_STATS_SATURATION
+    uint64_t sum;
+    uint32_t histogram[FRAME_STATS_BINS];
+};
+
+/* New frame of given pixels is started from slot */
+void frame_stats_start(const struct frame_slot_s *slot, uint32_t pixels);
+
+/* Count n pixels starting at pixel offset of the frame */
+void frame_stats_add(uint32_t offset, const uint16_t *pixels, size_t n);
+
+/* Last completed frame, valid until the next frame is completed */
+const struct frame_stats_s *frame_stats_get(void);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "usbd_conf.h"
+#include "usb_device.h"
+#include "frame_queue.h"
+
+/*
+ * Autoguider
+ *
+ * Host sets up to CAMERA_GUIDE_MAX_ROIS square ROIs around guide stars.
+ * After readout only these windows are read from SRAM and each gives one
+ * star: background and noise are the mean and deviation of the window
+ * border, pixels above background + GUIDE_THRESHOLD_SIGMA noise make the
+ * star, centroid is weighted by their signal above background.
+ *
+ * SNR is flux / sqrt(flux + pixels * noise^2), assuming 1 e-/ADU.
+ */
+
+#define GUIDE_MIN_ROI_SIZE      8U
+#define GUIDE_THRESHOLD_SIGMA   3U
+
+void guide_init(uint16_t width, uint16_t height);
+
+/* Called from USB interrupt. count 0 stops guiding */
+int guide_set_rois(unsigned count, unsigned size, uint16_t centers[][2]);
+void guide_get_rois(unsigned *count, unsigned *size, uint16_t centers[][2]);
+bool guide_active(void);
+
+/*
+ * Measure stars of the frame in slot, called from task: windows are read
+ * with QSPI DMA between stream reads. Returns number of stars in report
+ */
+unsigned guide_measure(const struct frame_slot_s *slot, struct guide_report_s *report);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "stm32f4xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* End of exposure, called from TIM5 interrupt */
+typedef void (*EXPOSURE_Callback)(void);
+
+int EXPOSURE_Init(void);
+
+/*
+ * Start exposure of duration us, SHUTTER pin is active for that time.
+ * Returns exposure which is really set, it can be rounded for exposures
+ * longer than 2^32 us, or 0 when exposure is in progress
+ */
+uint64_t EXPOSURE_Start(uint64_t duration, EXPOSURE_Callback cb);
+void EXPOSURE_Abort(void);
+bool EXPOSURE_Busy(void);
+
+/*
+ * External trigger: Arm loads the timer in advance, Fire starts exposure
+ * with SHUTTER edge right away and Stop ends it before its duration.
+ * Fire and Stop only write timer registers, they are called from
+ * trigger interrupt above FreeRTOS priorities
+ */
+uint64_t EXPOSURE_Arm(uint64_t duration, EXPOSURE_Callback cb);
+void EXPOSURE_Fire(void);
+void EXPOSURE_Stop(void);
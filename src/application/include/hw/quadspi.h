@@ -2,9 +2,23 @@
 
 #include "stm32f4xx_hal.h"
 #include <stdint.h>
+#include <stdbool.h>
+
+// FPGA SRAM in memory-mapped mode
+#define QUADSPI_MAPPED_BASE 0x90000000U
+
+typedef void (*QUADSPI_ReadCallback)(bool ok);
+typedef QUADSPI_ReadCallback QUADSPI_WriteCallback;
 
 int QUADSPI_Init(void);
 int QSPI_EnableMemoryMapped(void);
+int QSPI_DisableMemoryMapped(void);
 
 HAL_StatusTypeDef QUADSPI_Read(uint32_t address, uint8_t *buffer, uint32_t size);
+HAL_StatusTypeDef QUADSPI_Read_DMA(uint32_t address, uint8_t *buffer, uint32_t size, QUADSPI_ReadCallback cb);
 HAL_StatusTypeDef QUADSPI_Write(uint32_t address, uint8_t *buffer, uint32_t size);
+HAL_StatusTypeDef QUADSPI_Write_DMA(uint32_t address, uint8_t *buffer, uint32_t size, QUADSPI_WriteCallback cb);
+
+/* Blocking read and write from tasks, safe against stream reads from interrupts */
+HAL_StatusTypeDef QUADSPI_TaskRead(uint32_t address, uint8_t *buffer, uint32_t size);
+HAL_StatusTypeDef QUADSPI_TaskWrite(uint32_t address, const uint8_t *buffer, uint32_t size);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "stm32f4xx_hal.h"
+#include <stdint.h>
+
+int TIMESTAMP_Init(void);
+uint32_t TIMESTAMP_Get(void);
+/* Does not wrap, for spans longer than 2^32 ticks. Safe from any interrupt */
+uint64_t TIMESTAMP_Get64(void);
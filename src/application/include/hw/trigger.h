@@ -0,0 +1,34 @@
+#pragma once
+
+#include "stm32f4xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include "hw/exposure.h"
+
+/* Trigger to SHUTTER latency, ns */
+struct TRIGGER_Latency {
+    uint32_t last;
+    uint32_t min;
+    uint32_t max;
+    uint32_t count;
+};
+
+int TRIGGER_Init(void);
+
+/*
+ * Start exposure on rising edge of COMMAND_TRG. With bulb it ends on
+ * falling edge or after duration, whichever is first.
+ * Returns exposure which is really set, 0 on failure
+ */
+uint64_t TRIGGER_Arm(uint64_t duration, bool bulb, EXPOSURE_Callback cb);
+
+/*
+ * Returns false when trigger has already fired, its exposure goes on.
+ * Called after such exposure ends, it stops waiting for bulb end edge
+ */
+bool TRIGGER_Disarm(void);
+
+/* TIMESTAMP_Get64 of the last trigger */
+uint64_t TRIGGER_GetTime(void);
+
+void TRIGGER_GetLatency(struct TRIGGER_Latency *latency);
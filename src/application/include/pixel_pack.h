@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Packing of Y16 pixels into MIPI style packed formats,
+ * top 10 or 12 bits of each pixel are kept.
+ *
+ * Y12P: 2 pixels in 3 bytes, bits 11..4 of each pixel, then
+ *       bits 3..0 of pixel 0 and pixel 1 in one byte
+ * Y10P: 4 pixels in 5 bytes, bits 9..2 of each pixel, then
+ *       bits 1..0 of pixels 0..3 in one byte
+ *
+ * dst may be equal to src, packing is done in place then.
+ */
+
+#define PIXEL_PACK_Y12P_GROUP 2U
+#define PIXEL_PACK_Y10P_GROUP 4U
+
+/* npixels is a multiple of PIXEL_PACK_Y12P_GROUP, returns bytes written */
+size_t pack_y12p(uint8_t *dst, const uint16_t *src, size_t npixels);
+
+/* npixels is a multiple of PIXEL_PACK_Y10P_GROUP, returns bytes written */
+size_t pack_y10p(uint8_t *dst, const uint16_t *src, size_t npixels);
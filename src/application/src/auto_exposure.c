@@ -0,0 +1,68 @@
+#include "auto_exposure.h"
+
+uint32_t auto_exposure_level(const uint32_t *histogram, unsigned bins, uint32_t pixels, unsigned percentile)
+{
+    const uint32_t bin_width = 0x10000U / bins;
+    uint64_t needed = ((uint64_t)pixels * percentile + 99U) / 100U;
+    uint64_t below = 0;
+    unsigned i;
+
+    if (needed == 0)
+        needed = 1;
+    for (i = 0; i < bins; i++) {
+        if (below + histogram[i] >= needed) {
+            // pixels are spread evenly in the bin
+            uint32_t in_bin = (needed - below) * bin_width / histogram[i];
+            uint32_t level = i * bin_width + in_bin;
+            return level > 0xFFFFU ? 0xFFFFU : level;
+        }
+        below += histogram[i];
+    }
+    return 0xFFFFU;
+}
+
+bool auto_exposure_update(const struct auto_exposure_s *ae, uint32_t level, uint64_t *exposure, unsigned *gain)
+{
+    uint32_t target = ae->target;
+    if (target == 0)
+        target = 1;
+    uint32_t diff = level > target ? level - target : target - level;
+    if (diff <= target / AE_TOLERANCE)
+        return false;
+
+    // signal in us x gain units
+    uint64_t signal = *exposure * (AE_GAIN_UNITY + *gain);
+    uint64_t wanted;
+    if (level >= 0xFF00U)
+        wanted = signal / AE_MAX_STEP;     // clipped, real level is unknown
+    else if (level * AE_MAX_STEP < target)
+        wanted = signal * AE_MAX_STEP;
+    else if (level > target * AE_MAX_STEP)
+        wanted = signal / AE_MAX_STEP;
+    else
+        wanted = signal * target / level;
+
+    uint64_t max_exposure = ae->max_exposure;
+    uint64_t min_signal = (uint64_t)AE_MIN_EXPOSURE * AE_GAIN_UNITY;
+    if (wanted < min_signal)
+        wanted = min_signal;
+
+    unsigned new_gain = ae->auto_gain ? 0 : *gain;
+    uint64_t new_exposure = wanted / (AE_GAIN_UNITY + new_gain);
+    if (ae->auto_gain && new_exposure > max_exposure) {
+        new_exposure = max_exposure;
+        uint64_t g = wanted / max_exposure;
+        g = g > AE_GAIN_UNITY ? g - AE_GAIN_UNITY : 0;
+        new_gain = g > AE_GAIN_MAX ? AE_GAIN_MAX : g;
+    } else if (new_exposure > max_exposure) {
+        new_exposure = max_exposure;
+    }
+    if (new_exposure < AE_MIN_EXPOSURE)
+        new_exposure = AE_MIN_EXPOSURE;
+
+    if (new_exposure == *exposure && new_gain == *gain)
+        return false;
+    *exposure = new_exposure;
+    *gain = new_gain;
+    return true;
+}
@@ -3,6 +3,17 @@
 
 struct config_s camera_config;
 
+static void load_fourcc(uint16_t address, char *FourCC, const char *def)
+{
+    int i;
+    for (i = 0; i < 4; i++) {
+        uint8_t c = 0xFFU;
+        I2C_EEPROM_Read(address + i, &c);
+        // EEPROM written before packed formats were added keeps 0xFF there
+        FourCC[i] = (c == 0xFFU) ? def[i] : (char)c;
+    }
+}
+
 void load_config(struct config_s *cfg)
 {
     I2C_EEPROM_Read(0, &cfg->FourCC[0]);
@@ -22,4 +33,8 @@ void load_config(struct config_s *cfg)
     I2C_EEPROM_Read(6, &h_H);
     I2C_EEPROM_Read(7, &h_L);
     cfg->height = ((uint16_t)h_H)<<8 | h_L;
+
+    load_fourcc(8, cfg->FourCC_Y12P, "Y12P");
+    load_fourcc(12, cfg->FourCC_Y10P, "Y10P");
+    load_fourcc(16, cfg->FourCC_Rice, "Y16R");
 }
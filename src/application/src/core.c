@@ -1,10 +1,24 @@
 #include <stdbool.h>
+#include <string.h>
 #include <FreeRTOS.h>
 #include <task.h>
-#include <timers.h>
+#include <queue.h>
 #include <usb_device.h>
 
 #include "core.h"
+#include "config.h"
+#include "frame_reader.h"
+#include "frame_encoder.h"
+#include "frame_queue.h"
+#include "frame_stats.h"
+#include "auto_exposure.h"
+#include "guide.h"
+#include "frame_stack.h"
+#include "defect_map.h"
+#include "hw/quadspi.h"
+#include "hw/timestamp.h"
+#include "hw/exposure.h"
+#include "hw/trigger.h"
 
 enum exposure_mode_e {
     FREERUN = 0,
@@ -12,13 +26,45 @@ enum exposure_mode_e {
     TRIGGERED_BEGIN_END = 2,
 };
 
+/*
+ * Exposure state machine
+ *
+ * Sensor goes IDLE -> EXPOSURING -> READING -> IDLE, driven by events from
+ * the exposure queue. Frame is read out into its own SRAM slot and queued,
+ * USB uploads it from there while the sensor already takes the next one:
+ * exposure and readout of frame N+1 overlap with upload of frame N as long
+ * as there is a free slot. UPLOADING is not a sensor state any more, it is
+ * the state of slots held by USB.
+ *
+ * In FREERUN mode next exposure starts right after readout while video is
+ * streamed. In triggered modes the sensor is ARMED instead and exposure is
+ * started by COMMAND_TRG interrupt, TRIGGERED_BEGIN_END also ends it.
+ * Still image trigger starts one exposure in any mode.
+ */
 enum exposure_state_e {
     IDLE = 0,
+    ARMED,                  // waiting for external trigger
     EXPOSURING,
     READING,
     UPLOADING,
 };
 
+enum core_event_e {
+    EVENT_STREAM_START = 0,
+    EVENT_STREAM_STOP,
+    EVENT_MODE,             // trigger mode changed
+    EVENT_TRIGGER,          // still image requested
+    EVENT_GUIDE,            // guide ROIs changed
+    EVENT_RAW_START,        // raw interface started by host
+    EVENT_RAW_STOP,
+    EVENT_EXPOSURE_END,
+    EVENT_READOUT_END,
+};
+
+#define CORE_EVENT_QUEUE_LEN 8
+// retry period when all slots are held by readout and USB
+#define CORE_SLOT_RETRY_MS 10
+
 struct core_state_s
 {
     unsigned fan;
@@ -29,18 +75,70 @@ struct core_state_s
     unsigned current_temperature;
     unsigned window_temperature;
     unsigned gain;
-    unsigned exposure;
+    uint64_t exposure;      // us
+    unsigned ae_mode;       // VC_AE_MODE_*
 };
 
 
 static struct core_state_s state;
 static struct usb_context_s *usb_ctx;
-static StaticTimer_t exposure_timer_buffer;
-static TimerHandle_t exposure_timer;
-
-static void exposure_timer_cb( TimerHandle_t xTimer );
+static uint32_t frame_address;  // SRAM address of the frame being streamed
+static struct frame_slot_s *read_slot;      // slot of the frame being streamed
+static uint64_t read_slot_start;            // timestamp when its upload started
+static bool frame_started;                  // part of read_slot was sent
+static struct frame_slot_s *exposure_slot;  // slot of the frame being exposed
+static struct frame_slot_s *volatile still_slot;    // still image waiting for USB
+static bool compressed;         // frames are streamed Rice compressed
+static struct frame_slot_s *raw_slot;       // slot of the frame sent on raw interface
+static bool raw_pinned;                     // raw_slot is pinned for a resend
+static unsigned mapped_users;   // USB transfers reading memory-mapped SRAM
+
+// owned by exposure task
+static volatile enum exposure_state_e exposure_state;
+static bool streaming;
+static bool raw_streaming;
+static bool still_pending;      // still trigger waits for the sensor
+static bool still_exposing;     // exposure in progress is still image
+static uint64_t exposure_start;   // TIMESTAMP_Get64, exposures may be longer than TIM2 wrap
+static uint64_t exposure_end;
+static bool exposure_end_valid;     // exposure_end is of the previous frame, for dead time
+static uint64_t readout_start;
+
+static struct core_timing_s timing;
+
+static struct auto_exposure_s ae;
+static uint32_t ae_sequence;    // frame used by the last auto exposure step
+
+static StaticQueue_t event_queue_buffer;
+static uint8_t event_queue_storage[CORE_EVENT_QUEUE_LEN];
+static QueueHandle_t event_queue;
+
+static bool start_exposure(void);
 static void read_ccd(void);
 
+static void timing_add(struct core_stage_timing_s *stage, uint64_t start, uint64_t end)
+{
+    // stages longer than 2^32 us are counted as that
+    uint32_t t = end - start > UINT32_MAX ? UINT32_MAX : (uint32_t)(end - start);
+    stage->last = t;
+    if (stage->count == 0 || t < stage->min)
+        stage->min = t;
+    if (t > stage->max)
+        stage->max = t;
+    stage->sum += t;
+    stage->count++;
+}
+
+static uint8_t post_event_from_isr(enum core_event_e event)
+{
+    uint8_t ev = event;
+    BaseType_t woken = pdFALSE;
+    if (xQueueSendFromISR(event_queue, &ev, &woken) != pdPASS)
+        return USBD_FAIL;
+    portYIELD_FROM_ISR(woken);
+    return USBD_OK;
+}
+
 struct usb_context_s;
 
 static uint8_t set_target_temperature_cb(unsigned temperature)
@@ -70,6 +168,263 @@ static uint8_t serial_data_cb(const uint8_t *data, size_t len)
     return USBD_OK;
 }
 
+static void read_frame_completed_cb(bool ok)
+{
+    if (ok)
+        frame_started = true;
+    frame_chunk_filled(ok);
+}
+
+static void read_frame_encoded_cb(bool ok, size_t len, bool eof)
+{
+    if (ok) {
+        frame_started = true;
+        frame_chunk_filled_size(len, eof);
+    } else {
+        frame_chunk_filled(false);
+    }
+}
+
+static void fill_metadata(const struct frame_slot_s *slot, struct frame_metadata_s *metadata)
+{
+    struct frame_queue_stats_s stats;
+    frame_queue_get_stats(&stats);
+
+    *metadata = (struct frame_metadata_s) {
+        .version = FRAME_METADATA_VERSION,
+        .flags = slot->flags,
+        .gain = slot->gain,
+        .sequence = slot->sequence,
+        .exposure = slot->exposure,
+        .exposure_start = slot->pts,
+        .exposure_end = slot->end,
+        .temperature = slot->temperature,
+        .window_temperature = slot->window_temperature,
+        .target_temperature = slot->target_temperature,
+        .window_heater = slot->window_heater,
+        .trigger_mode = slot->trigger_mode,
+        .dropped = stats.dropped,
+    };
+}
+
+static void send_metadata(const struct frame_slot_s *slot)
+{
+    struct frame_metadata_s metadata;
+    fill_metadata(slot, &metadata);
+    frame_set_metadata(&metadata);
+}
+
+/*
+ * New frame is started by USB. Take the oldest queued frame, when there is
+ * no one, the last frame is sent again
+ */
+static void next_frame(void)
+{
+    if (read_slot != NULL && !frame_started)
+        return;     // first chunk of the frame is read again
+
+    // still image goes before video frames queued while it was exposed
+    struct frame_slot_s *slot = still_slot;
+    if (slot == NULL || !frame_queue_acquire_read_slot(slot))
+        slot = frame_queue_acquire_read();
+    if (slot == NULL)
+        return;
+    uint64_t now = TIMESTAMP_Get64();
+    if (read_slot != NULL) {
+        frame_queue_release_read(read_slot);
+        timing_add(&timing.upload, read_slot_start, now);
+    }
+    read_slot = slot;
+    read_slot_start = now;
+    frame_started = false;
+    frame_address = slot->address;
+    uint16_t width, height;
+    frame_reader_get_size(&width, &height);
+    frame_stats_start(slot, (uint32_t)width * height);
+    frame_set_pts(slot->pts);
+    send_metadata(slot);
+}
+
+static uint8_t read_frame(uint32_t offset, uint8_t *buf, size_t len)
+{
+    HAL_StatusTypeDef res;
+    if (offset == 0)
+        next_frame();
+    if (compressed)
+        res = frame_encoder_read(frame_address, offset, buf, len, read_frame_encoded_cb);
+    else
+        res = frame_reader_read(frame_address, offset, buf, len, read_frame_completed_cb);
+    if (res != HAL_OK)
+        return USBD_BUSY;
+    return USBD_OK;
+}
+
+/*
+ * Ranges sent straight from SRAM skip frame_reader, so there is no hot
+ * pixel correction and no statistics for them. Only plain Y16 frames go
+ * this way, with manual exposure and an empty defect map
+ */
+static uint8_t map_frame(uint32_t offset, size_t len, const uint8_t **data)
+{
+    if (read_slot == NULL || compressed || !frame_reader_is_direct())
+        return USBD_FAIL;
+    if (state.ae_mode != VC_AE_MODE_MANUAL || defect_map_count() != 0)
+        return USBD_FAIL;
+    *data = (const uint8_t *)(QUADSPI_MAPPED_BASE + frame_address + offset);
+    return USBD_OK;
+}
+
+/* UVC and raw interface map SRAM independently, it stays mapped until both are done */
+static uint8_t set_mapped(bool mapped)
+{
+    if (!mapped) {
+        if (mapped_users > 0 && --mapped_users == 0)
+            QSPI_DisableMemoryMapped();
+        return USBD_OK;
+    }
+    // indirect read from a task or the stream is running
+    if (mapped_users == 0 && QSPI_EnableMemoryMapped() != HAL_OK)
+        return USBD_BUSY;
+    mapped_users++;
+    return USBD_OK;
+}
+
+static uint8_t raw_start(void)
+{
+    return post_event_from_isr(EVENT_RAW_START);
+}
+
+static uint8_t raw_stop(void)
+{
+    return post_event_from_isr(EVENT_RAW_STOP);
+}
+
+/*
+ * Raw interface takes queued frames in order, as they are in SRAM. With
+ * UVC streaming at the same time each frame goes to one of them only
+ */
+static void raw_fill_header(struct raw_frame_header_s *header)
+{
+    header->magic = RAW_FRAME_MAGIC;
+    header->version = RAW_FRAME_VERSION;
+    header->header_len = CAMERA_RAW_HEADER_LEN;
+    header->width = camera_config.width;
+    header->height = camera_config.height;
+    header->bits = 16U;
+}
+
+static uint8_t raw_next_frame(struct raw_frame_header_s *header, const uint8_t **data, uint32_t *size)
+{
+    struct frame_slot_s *slot = frame_queue_acquire_read();
+    if (slot == NULL)
+        return USBD_BUSY;
+    raw_slot = slot;
+    raw_pinned = false;
+
+    raw_fill_header(header);
+    header->size = (uint32_t)camera_config.width * camera_config.height * 2U;
+    fill_metadata(slot, &header->metadata);
+
+    *data = (const uint8_t *)(QUADSPI_MAPPED_BASE + slot->address);
+    *size = header->size;
+    return USBD_OK;
+}
+
+/*
+ * Frame is pinned while the range is sent, it can be queued or sent on
+ * UVC at the same time. Offset is word aligned for OTG DMA
+ */
+static uint8_t raw_resend_frame(struct raw_frame_header_s *header, uint32_t sequence, uint32_t offset,
+                                uint32_t length, const uint8_t **data, uint32_t *size)
+{
+    uint32_t frame_size = (uint32_t)camera_config.width * camera_config.height * 2U;
+    raw_fill_header(header);
+    header->flags = RAW_FRAME_RESENT;
+    header->offset = offset;
+
+    struct frame_slot_s *slot = NULL;
+    if (offset % 4U == 0 && offset < frame_size && length <= frame_size - offset)
+        slot = frame_queue_pin(sequence);
+    if (slot == NULL) {
+        header->flags |= RAW_FRAME_GONE;
+        *data = NULL;
+        *size = 0;
+        return USBD_OK;
+    }
+    raw_slot = slot;
+    raw_pinned = true;
+
+    if (length == 0)
+        length = frame_size - offset;
+    header->size = length;
+    fill_metadata(slot, &header->metadata);
+
+    *data = (const uint8_t *)(QUADSPI_MAPPED_BASE + slot->address + offset);
+    *size = length;
+    return USBD_OK;
+}
+
+static uint8_t raw_frame_done(void)
+{
+    if (raw_slot != NULL && raw_pinned)
+        frame_queue_unpin(raw_slot);
+    else if (raw_slot != NULL)
+        frame_queue_release_read(raw_slot);
+    raw_slot = NULL;
+    return USBD_OK;
+}
+
+static uint8_t set_binning(unsigned binning)
+{
+    if (frame_reader_set_binning(binning) != HAL_OK)
+        return USBD_FAIL;
+    return USBD_OK;
+}
+
+static uint8_t set_packing(unsigned bits)
+{
+    if (frame_reader_set_packing(bits) != HAL_OK)
+        return USBD_FAIL;
+    return USBD_OK;
+}
+
+static uint8_t set_compression(bool enable)
+{
+    compressed = enable;
+    return USBD_OK;
+}
+
+/*
+ * Still image trigger, called from USB or trigger input interrupt:
+ * exactly one exposure, its frame is sent when readout is done
+ */
+static uint8_t still_trigger(void)
+{
+    return post_event_from_isr(EVENT_TRIGGER);
+}
+
+static uint8_t still_done(void)
+{
+    still_slot = NULL;
+    return USBD_OK;
+}
+
+static uint8_t start_stream(void)
+{
+    return post_event_from_isr(EVENT_STREAM_START);
+}
+
+static uint8_t stop_stream(void)
+{
+    return post_event_from_isr(EVENT_STREAM_STOP);
+}
+
+static uint8_t get_timestamp(uint32_t *timestamp)
+{
+    *timestamp = TIMESTAMP_Get();
+    return USBD_OK;
+}
+
 static uint8_t get_gain(unsigned *gain)
 {
     *gain = state.gain;
@@ -82,13 +437,28 @@ static uint8_t set_gain(unsigned gain)
     return USBD_OK;
 }
 
+/* UVC exposure time, 100 us units */
 static uint8_t get_exposure(uint32_t *exposure)
 {
-    *exposure = state.exposure;
+    uint64_t e = state.exposure / 100U;
+    *exposure = e > UINT32_MAX ? UINT32_MAX : (uint32_t)e;
     return USBD_OK;
 }
 
 static uint8_t set_exposure(uint32_t exposure)
+{
+    state.exposure = (uint64_t)exposure * 100U;
+    return USBD_OK;
+}
+
+/* Fine exposure time, us */
+static uint8_t get_exposure_us(uint32_t *exposure)
+{
+    *exposure = state.exposure > UINT32_MAX ? UINT32_MAX : (uint32_t)state.exposure;
+    return USBD_OK;
+}
+
+static uint8_t set_exposure_us(uint32_t exposure)
 {
     state.exposure = exposure;
     return USBD_OK;
@@ -139,6 +509,92 @@ static uint8_t get_trigger_mode(unsigned *trigger_mode)
 static uint8_t set_trigger_mode(unsigned trigger_mode)
 {
     state.trigger_mode = trigger_mode;
+    return post_event_from_isr(EVENT_MODE);
+}
+
+static uint8_t set_ae_mode(unsigned mode)
+{
+    if (mode != VC_AE_MODE_MANUAL && mode != VC_AE_MODE_AUTO && mode != VC_AE_MODE_APERTURE_PRIORITY)
+        return USBD_FAIL;
+    state.ae_mode = mode;
+    return USBD_OK;
+}
+
+static uint8_t get_ae_mode(unsigned *mode)
+{
+    *mode = state.ae_mode;
+    return USBD_OK;
+}
+
+static uint8_t set_ae_target(unsigned target, unsigned percentile)
+{
+    if (target > 0xFFFFU || percentile > 100U)
+        return USBD_FAIL;
+    ae.target = target;
+    ae.percentile = percentile;
+    return USBD_OK;
+}
+
+static uint8_t get_ae_target(unsigned *target, unsigned *percentile)
+{
+    *target = ae.target;
+    *percentile = ae.percentile;
+    return USBD_OK;
+}
+
+static uint8_t set_guide_rois(unsigned count, unsigned size, uint16_t centers[][2])
+{
+    if (guide_set_rois(count, size, centers) != 0)
+        return USBD_FAIL;
+    return post_event_from_isr(EVENT_GUIDE);
+}
+
+static uint8_t get_guide_rois(unsigned *count, unsigned *size, uint16_t centers[][2])
+{
+    guide_get_rois(count, size, centers);
+    return USBD_OK;
+}
+
+static uint8_t set_stack(unsigned depth, unsigned flags, unsigned shift)
+{
+    if (frame_stack_set(depth, flags, shift) != 0)
+        return USBD_FAIL;
+    return USBD_OK;
+}
+
+static uint8_t get_stack(unsigned *depth, unsigned *flags, unsigned *shift)
+{
+    frame_stack_get(depth, flags, shift);
+    return USBD_OK;
+}
+
+/* Called from USB interrupt, statistics are published from QSPI one of the same priority */
+static uint8_t get_frame_stats(uint32_t stats[6])
+{
+    const struct frame_stats_s *s = frame_stats_get();
+    stats[0] = s->sequence;
+    stats[1] = s->pixels;
+    stats[2] = s->min;
+    stats[3] = s->max;
+    stats[4] = s->mean;
+    stats[5] = s->saturated;
+    return USBD_OK;
+}
+
+static uint8_t get_frame_histogram(uint32_t histogram[CAMERA_STATS_BINS])
+{
+    memcpy(histogram, frame_stats_get()->histogram, sizeof(uint32_t) * CAMERA_STATS_BINS);
+    return USBD_OK;
+}
+
+static uint8_t get_trigger_latency(uint32_t latency[4])
+{
+    struct TRIGGER_Latency l;
+    TRIGGER_GetLatency(&l);
+    latency[0] = l.last;
+    latency[1] = l.min;
+    latency[2] = l.max;
+    latency[3] = l.count;
     return USBD_OK;
 }
 
@@ -171,21 +627,61 @@ void core_init(struct usb_context_s *ctx)
     usb_ctx = ctx;
     usb_ctx->set_target_temperature = set_target_temperature_cb;
     usb_ctx->serial_data = serial_data_cb;
+    usb_ctx->read_frame = read_frame;
+    usb_ctx->map_frame = map_frame;
+    usb_ctx->set_mapped = set_mapped;
+    usb_ctx->raw_start = raw_start;
+    usb_ctx->raw_stop = raw_stop;
+    usb_ctx->raw_next_frame = raw_next_frame;
+    usb_ctx->raw_resend_frame = raw_resend_frame;
+    usb_ctx->raw_frame_done = raw_frame_done;
+    usb_ctx->get_timestamp = get_timestamp;
+    usb_ctx->set_binning = set_binning;
+    usb_ctx->set_packing = set_packing;
+    usb_ctx->set_compression = set_compression;
+    usb_ctx->still_trigger = still_trigger;
+    usb_ctx->still_done = still_done;
+    usb_ctx->start_stream = start_stream;
+    usb_ctx->stop_stream = stop_stream;
+    usb_ctx->get_trigger_mode = get_trigger_mode;
+    usb_ctx->set_trigger_mode = set_trigger_mode;
+    usb_ctx->get_trigger_latency = get_trigger_latency;
+    usb_ctx->get_frame_stats = get_frame_stats;
+    usb_ctx->get_frame_histogram = get_frame_histogram;
+    usb_ctx->set_ae_mode = set_ae_mode;
+    usb_ctx->get_ae_mode = get_ae_mode;
+    usb_ctx->set_ae_target = set_ae_target;
+    usb_ctx->get_ae_target = get_ae_target;
+    usb_ctx->set_guide_rois = set_guide_rois;
+    usb_ctx->get_guide_rois = get_guide_rois;
+    usb_ctx->set_stack = set_stack;
+    usb_ctx->get_stack = get_stack;
     usb_ctx->get_gain = get_gain;
     usb_ctx->set_gain = set_gain;
     usb_ctx->get_exposure = get_exposure;
     usb_ctx->set_exposure = set_exposure;
+    usb_ctx->get_exposure_us = get_exposure_us;
+    usb_ctx->set_exposure_us = set_exposure_us;
 
-    state.exposure = VC_DEFAULT_EXPOSURE;
+    state.exposure = VC_DEFAULT_EXPOSURE * 100ULL;
+    state.ae_mode = VC_AE_MODE_MANUAL;
+    ae.target = VC_DEFAULT_AE_TARGET;
+    ae.percentile = VC_DEFAULT_AE_PERCENTILE;
+    ae.max_exposure = AE_MAX_EXPOSURE;
+    frame_reader_init(camera_config.width, camera_config.height);
+    uint32_t stack_size = frame_stack_init(camera_config.width, camera_config.height);
+    frame_queue_init(camera_config.width, camera_config.height, SRAM_SIZE - stack_size);
+    guide_init(camera_config.width, camera_config.height);
 
-    exposure_timer = xTimerCreateStatic(
-        "ExposureTimer",              // Name
-        pdMS_TO_TICKS(1000),          // Period: 1 second
-        pdFALSE,                      // Auto reload = false
-        NULL,                         // Timer ID
-        exposure_timer_cb,            // Callback function
-        &exposure_timer_buffer        // Static buffer
-    );
+    event_queue = xQueueCreateStatic(CORE_EVENT_QUEUE_LEN, sizeof(uint8_t),
+                                     event_queue_storage, &event_queue_buffer);
+}
+
+void core_get_timing(struct core_timing_s *t)
+{
+    taskENTER_CRITICAL();
+    *t = timing;
+    taskEXIT_CRITICAL();
 }
 
 void core_sensors_poll_function(void *arg)
@@ -198,32 +694,278 @@ void core_sensors_poll_function(void *arg)
     }
 }
 
-static void start_exposure(void)
+/* End of exposure, called from TIM5 interrupt */
+static void exposure_end_cb(void)
 {
+    exposure_end = TIMESTAMP_Get64();
+    post_event_from_isr(EVENT_EXPOSURE_END);
 }
 
-static void complete_exposure(void)
+/* Camera state at exposure start, sent to host with the frame */
+static void fill_slot_state(struct frame_slot_s *slot)
 {
+    slot->gain = state.gain;
+    slot->temperature = state.current_temperature;
+    slot->window_temperature = state.window_temperature;
+    slot->target_temperature = state.target_temperature;
+    slot->window_heater = state.window_heater;
+    slot->trigger_mode = state.trigger_mode;
+    slot->flags = 0;
+    if (state.tec)
+        slot->flags |= FRAME_METADATA_TEC;
+    if (state.fan)
+        slot->flags |= FRAME_METADATA_FAN;
 }
 
-static void read_ccd(void)
+static bool start_exposure(void)
 {
-    core_read_ccd_completed_cb();
+    uint64_t start = TIMESTAMP_Get64();
+    uint64_t exposure = EXPOSURE_Start(state.exposure, exposure_end_cb);
+    if (exposure == 0)
+        return false;
+
+    if (exposure_end_valid)
+        timing_add(&timing.dead, exposure_end, start);
+    exposure_start = start;
+
+    // PTS of the frame, sent to host when USB takes the slot
+    exposure_slot->pts = (uint32_t)start;
+    exposure_slot->exposure = exposure;
+    fill_slot_state(exposure_slot);
+    if (still_pending)
+        exposure_slot->flags |= FRAME_METADATA_STILL;
+    return true;
+}
+
+static bool triggered_mode(void)
+{
+    return state.trigger_mode == TRIGGERED_BEGIN || state.trigger_mode == TRIGGERED_BEGIN_END;
 }
 
-static void exposure_timer_cb(TimerHandle_t xTimer)
+static bool arm_exposure(void)
 {
-    complete_exposure();
+    uint64_t exposure = TRIGGER_Arm(state.exposure, state.trigger_mode == TRIGGERED_BEGIN_END,
+                                    exposure_end_cb);
+    if (exposure == 0)
+        return false;
+    exposure_slot->exposure = exposure;
+    fill_slot_state(exposure_slot);
+    exposure_state = ARMED;
+    return true;
 }
 
-static void start_exposure_timer(int exposure)
+/* Give slot back when trigger has not fired yet */
+static void disarm_exposure(void)
 {
-    xTimerChangePeriod(exposure_timer, pdMS_TO_TICKS(exposure), 0);
-    xTimerStart(exposure_timer, 0);
+    if (exposure_state != ARMED || !TRIGGER_Disarm())
+        return;
+    frame_queue_abort_write(exposure_slot);
+    exposure_slot = NULL;
+    exposure_state = IDLE;
 }
 
+/*
+ * Exposure and gain for the next frame from the last streamed one, each
+ * frame is used once. Statistics are swapped by QSPI interrupt, so the
+ * level is found with it masked
+ */
+static void auto_exposure_step(void)
+{
+    if (state.ae_mode == VC_AE_MODE_MANUAL)
+        return;
+
+    taskENTER_CRITICAL();
+    const struct frame_stats_s *s = frame_stats_get();
+    uint32_t sequence = s->sequence;
+    uint32_t pixels = s->pixels;
+    uint64_t exposure = s->exposure;
+    unsigned gain = s->gain;
+    uint32_t level = 0;
+    if (pixels != 0 && sequence != ae_sequence)
+        level = auto_exposure_level(s->histogram, FRAME_STATS_BINS, pixels, ae.percentile);
+    taskEXIT_CRITICAL();
+
+    if (pixels == 0 || sequence == ae_sequence)
+        return;
+    ae_sequence = sequence;
+    ae.auto_gain = state.ae_mode == VC_AE_MODE_AUTO;
+    if (!auto_exposure_update(&ae, level, &exposure, &gain))
+        return;
+
+    taskENTER_CRITICAL();
+    state.exposure = exposure;
+    state.gain = gain;
+    taskEXIT_CRITICAL();
+}
+
+/* Start next exposure when sensor is idle and somebody waits for a frame */
+static bool try_start_exposure(void)
+{
+    if (exposure_state != IDLE)
+        return true;
+    // guiding takes frames even when host does not stream video
+    bool video = (streaming || raw_streaming || guide_active()) && (state.trigger_mode == FREERUN || triggered_mode());
+    if (!still_pending && !video)
+        return true;
+
+    auto_exposure_step();
+    exposure_slot = frame_queue_acquire_write();
+    if (exposure_slot == NULL)
+        return false;
+
+    if (!still_pending && triggered_mode()) {
+        if (!arm_exposure()) {
+            frame_queue_abort_write(exposure_slot);
+            exposure_slot = NULL;
+        }
+        return true;
+    }
+
+    if (!start_exposure()) {
+        frame_queue_abort_write(exposure_slot);
+        exposure_slot = NULL;
+        still_pending = false;
+        return true;
+    }
+    still_exposing = still_pending;
+    still_pending = false;
+    exposure_state = EXPOSURING;
+    return true;
+}
+
+static void complete_exposure(void)
+{
+    if (exposure_state == ARMED) {
+        // started by trigger interrupt, PTS is the trigger time
+        TRIGGER_Disarm();
+        exposure_start = TRIGGER_GetTime();
+        exposure_slot->pts = (uint32_t)exposure_start;
+        exposure_slot->flags |= FRAME_METADATA_TRIGGERED;
+        if (state.trigger_mode == TRIGGERED_BEGIN_END)
+            exposure_slot->exposure = (exposure_end - exposure_start) * 1000000U / TIMESTAMP_FREQ;
+        exposure_state = EXPOSURING;
+    }
+    if (exposure_state != EXPOSURING)
+        return;
+    timing_add(&timing.exposure, exposure_start, exposure_end);
+    exposure_end_valid = true;
+    exposure_slot->end = (uint32_t)exposure_end;
+    exposure_state = READING;
+    readout_start = exposure_end;
+    read_ccd();
+}
+
+static void complete_readout(void)
+{
+    if (exposure_state != READING)
+        return;
+    timing_add(&timing.readout, readout_start, TIMESTAMP_Get64());
+    timing.frames++;
+
+    if (guide_active()) {
+        struct guide_report_s report;
+        unsigned stars = guide_measure(exposure_slot, &report);
+        taskENTER_CRITICAL();
+        send_guide_report(&report, stars);
+        taskEXIT_CRITICAL();
+    }
+
+    bool send = true;
+    if (still_exposing) {
+        still_exposing = false;
+        still_slot = exposure_slot;
+    } else if (!streaming && !raw_streaming) {
+        // frame was taken only for guiding
+        send = false;
+    } else if (frame_stack_active()) {
+        // only complete stack is sent
+        send = frame_stack_add(exposure_slot);
+    }
+    if (send)
+        frame_queue_commit_write(exposure_slot);
+    else
+        frame_queue_abort_write(exposure_slot);
+    exposure_slot = NULL;
+    exposure_state = IDLE;
+
+    // still image was aborted by host, frame goes as a video one
+    if (still_slot != NULL && frame_still_ready() != USBD_OK)
+        still_slot = NULL;
+}
+
+/*
+ * Frame is read out into exposure_slot->address. Its end is reported at
+ * once, a readout interrupt calls core_read_ccd_completed_cb instead
+ * when the sensor readout takes time
+ */
+static void read_ccd(void)
+{
+    core_read_ccd_completed_cb();
+}
+
+/* Readout DMA is done, called from interrupt */
 void core_read_ccd_completed_cb(void)
 {
+    post_event_from_isr(EVENT_READOUT_END);
+}
+
+void core_exposure_function(void *arg)
+{
+    bool waiting_slot = false;
+    while (1) {
+        uint8_t ev;
+        TickType_t wait = waiting_slot ? pdMS_TO_TICKS(CORE_SLOT_RETRY_MS) : portMAX_DELAY;
+        if (xQueueReceive(event_queue, &ev, wait) == pdPASS) {
+            switch (ev)
+            {
+            case EVENT_STREAM_START:
+                streaming = true;
+                if (exposure_state == IDLE)
+                    exposure_end_valid = false;     // no dead time before first frame
+                break;
+            case EVENT_STREAM_STOP:
+                streaming = false;
+                if (!raw_streaming)
+                    disarm_exposure();
+                break;
+            case EVENT_RAW_START:
+                raw_streaming = true;
+                if (exposure_state == IDLE)
+                    exposure_end_valid = false;
+                break;
+            case EVENT_RAW_STOP:
+                raw_streaming = false;
+                if (!streaming)
+                    disarm_exposure();
+                break;
+            case EVENT_MODE:
+                disarm_exposure();
+                break;
+            case EVENT_GUIDE:
+                if (!streaming && !raw_streaming && !guide_active())
+                    disarm_exposure();
+                break;
+            case EVENT_TRIGGER:
+                still_pending = true;
+                // still image does not wait for external trigger
+                disarm_exposure();
+                if (exposure_state == IDLE)
+                    exposure_end_valid = false;
+                break;
+            case EVENT_EXPOSURE_END:
+                complete_exposure();
+                break;
+            case EVENT_READOUT_END:
+                complete_readout();
+                break;
+            default:
+                break;
+            }
+        }
+        waiting_slot = !try_start_exposure();
+        if (waiting_slot)
+            timing.slot_waits++;
+    }
 }
 
 void core_process_exposure_cb(unsigned exposure)
@@ -0,0 +1,203 @@
+#include <stdbool.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "defect_map.h"
+#include "hw/i2c.h"
+
+static struct {
+    uint16_t width;
+    uint16_t height;
+    unsigned count;
+    unsigned cursor;        // first defect not before the last range
+    uint32_t cursor_offset; // end of the last range
+    uint32_t defects[DEFECT_MAP_MAX];   // y * width + x, sorted
+} map;
+
+static unsigned lower_bound(uint32_t offset)
+{
+    unsigned lo = 0, hi = map.count;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2U;
+        if (map.defects[mid] < offset)
+            lo = mid + 1U;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void read_u16(uint16_t address, uint16_t *value)
+{
+    uint8_t h = 0xFFU, l = 0xFFU;
+    I2C_EEPROM_Read(address, &h);
+    I2C_EEPROM_Read(address + 1U, &l);
+    *value = ((uint16_t)h) << 8 | l;
+}
+
+static HAL_StatusTypeDef write_u16(uint16_t address, uint16_t value)
+{
+    uint8_t h = value >> 8;
+    uint8_t l = value & 0xFFU;
+    HAL_StatusTypeDef res = I2C_EEPROM_Write(address, &h);
+    if (res != HAL_OK)
+        return res;
+    return I2C_EEPROM_Write(address + 1U, &l);
+}
+
+void defect_map_load(uint16_t width, uint16_t height)
+{
+    uint16_t count, i;
+    map.width = width;
+    map.height = height;
+    map.count = 0;
+    map.cursor = 0;
+    map.cursor_offset = 0;
+
+    read_u16(DEFECT_MAP_EEPROM_ADDR, &count);
+    // erased EEPROM reads 0xFFFF
+    if (count > DEFECT_MAP_MAX)
+        return;
+
+    for (i = 0; i < count; i++) {
+        uint16_t x, y;
+        read_u16(DEFECT_MAP_EEPROM_ADDR + 2U + i * 4U, &x);
+        read_u16(DEFECT_MAP_EEPROM_ADDR + 4U + i * 4U, &y);
+        if (x >= width || y >= height)
+            continue;
+        uint32_t offset = (uint32_t)y * width + x;
+        // list is stored sorted, keep it so if it was written by hand
+        unsigned pos = map.count;
+        while (pos > 0 && map.defects[pos - 1U] > offset)
+            pos--;
+        if (pos > 0 && map.defects[pos - 1U] == offset)
+            continue;
+        memmove(&map.defects[pos + 1U], &map.defects[pos], (map.count - pos) * sizeof(map.defects[0]));
+        map.defects[pos] = offset;
+        map.count++;
+    }
+}
+
+/* Store defects from index first on, entries before it are unchanged */
+static int store(unsigned first)
+{
+    unsigned i;
+    for (i = first; i < map.count; i++) {
+        uint16_t x = map.defects[i] % map.width;
+        uint16_t y = map.defects[i] / map.width;
+        if (write_u16(DEFECT_MAP_EEPROM_ADDR + 2U + i * 4U, x) != HAL_OK)
+            return -1;
+        if (write_u16(DEFECT_MAP_EEPROM_ADDR + 4U + i * 4U, y) != HAL_OK)
+            return -1;
+    }
+    if (write_u16(DEFECT_MAP_EEPROM_ADDR, map.count) != HAL_OK)
+        return -1;
+    return 0;
+}
+
+int defect_map_add(uint16_t x, uint16_t y)
+{
+    if (x >= map.width || y >= map.height)
+        return -1;
+    uint32_t offset = (uint32_t)y * map.width + x;
+
+    taskENTER_CRITICAL();
+    unsigned pos = lower_bound(offset);
+    bool exists = pos < map.count && map.defects[pos] == offset;
+    bool full = map.count == DEFECT_MAP_MAX;
+    if (!exists && !full) {
+        memmove(&map.defects[pos + 1U], &map.defects[pos], (map.count - pos) * sizeof(map.defects[0]));
+        map.defects[pos] = offset;
+        map.count++;
+        map.cursor_offset = 0xFFFFFFFFU;    // cursor is searched again
+    }
+    taskEXIT_CRITICAL();
+
+    if (exists)
+        return 0;
+    if (full)
+        return -1;
+    return store(pos);
+}
+
+int defect_map_remove(uint16_t x, uint16_t y)
+{
+    if (x >= map.width || y >= map.height)
+        return -1;
+    uint32_t offset = (uint32_t)y * map.width + x;
+
+    taskENTER_CRITICAL();
+    unsigned pos = lower_bound(offset);
+    bool exists = pos < map.count && map.defects[pos] == offset;
+    if (exists) {
+        memmove(&map.defects[pos], &map.defects[pos + 1U], (map.count - pos - 1U) * sizeof(map.defects[0]));
+        map.count--;
+        map.cursor_offset = 0xFFFFFFFFU;
+    }
+    taskEXIT_CRITICAL();
+
+    if (!exists)
+        return -1;
+    return store(pos);
+}
+
+int defect_map_clear(void)
+{
+    taskENTER_CRITICAL();
+    map.count = 0;
+    map.cursor_offset = 0xFFFFFFFFU;
+    taskEXIT_CRITICAL();
+    return store(0);
+}
+
+unsigned defect_map_count(void)
+{
+    return map.count;
+}
+
+int defect_map_get(unsigned index, uint16_t *x, uint16_t *y)
+{
+    int res = -1;
+    taskENTER_CRITICAL();
+    if (index < map.count) {
+        *x = map.defects[index] % map.width;
+        *y = map.defects[index] / map.width;
+        res = 0;
+    }
+    taskEXIT_CRITICAL();
+    return res;
+}
+
+void defect_map_apply(uint32_t offset, uint16_t *pixels, size_t n)
+{
+    uint32_t end = offset + n;
+    unsigned i = map.cursor;
+
+    if (offset < map.cursor_offset)
+        i = lower_bound(offset);
+    while (i < map.count && map.defects[i] < offset)
+        i++;
+
+    for (; i < map.count && map.defects[i] < end; i++) {
+        uint32_t d = map.defects[i];
+        unsigned x = d % map.width;
+        uint32_t sum = 0;
+        unsigned num = 0;
+        // left one is corrected already, right one is used unless it is a defect too
+        if (x > 0 && d > offset) {
+            sum += pixels[d - 1U - offset];
+            num++;
+        }
+        if (x + 1U < map.width && d + 1U < end &&
+            (i + 1U == map.count || map.defects[i + 1U] != d + 1U)) {
+            sum += pixels[d + 1U - offset];
+            num++;
+        }
+        if (num != 0)
+            pixels[d - offset] = (sum + num / 2U) / num;
+    }
+
+    map.cursor = i;
+    map.cursor_offset = end;
+}
@@ -0,0 +1,211 @@
+#ifndef STM32F446xx
+#define STM32F446xx
+#endif
+
+#include <string.h>
+
+#include "stm32f446xx.h"
+#include "system_config.h"
+#include "frame_reader.h"
+#include "frame_encoder.h"
+
+/*
+ * Frame encoder
+ *
+ * Streams the coded frame chunk by chunk. Y16 rows are read with
+ * frame_reader into row, coded into coded and copied out to chunk
+ * buffers from there, so chunks don't need to align with rows.
+ *
+ * A chunk which can't be filled because row read failed is reported
+ * with the bytes it has so far, read is retried by the next request.
+ *
+ * Continuation runs from QSPI DMA interrupt.
+ */
+
+struct bit_writer_s {
+    uint8_t *p;
+    uint32_t acc;
+    unsigned n;     // bits in acc not written yet, < 8
+};
+
+/* n <= 24 */
+static inline void put_bits(struct bit_writer_s *bw, uint32_t val, unsigned n)
+{
+    bw->acc = (bw->acc << n) | val;
+    bw->n += n;
+    while (bw->n >= 8) {
+        bw->n -= 8;
+        *bw->p++ = bw->acc >> bw->n;
+    }
+}
+
+static inline void flush_bits(struct bit_writer_s *bw)
+{
+    if (bw->n > 0)
+        put_bits(bw, 0, 8 - bw->n);
+}
+
+static void encode_block(struct bit_writer_s *bw, const uint16_t *u, unsigned n)
+{
+    unsigned i;
+    uint32_t sum = 0;
+    for (i = 0; i < n; i++)
+        sum += u[i];
+
+    // k close to log2 of mean residual is near optimal for geometric distribution
+    uint32_t mean = sum / n;
+    unsigned k = mean > 0 ? 31U - __CLZ(mean) : 0;
+    if (k > FRAME_ENCODER_RAW - 1U)
+        k = FRAME_ENCODER_RAW - 1U;
+
+    uint32_t cost = 0;
+    for (i = 0; i < n; i++) {
+        uint32_t q = u[i] >> k;
+        cost += q < FRAME_ENCODER_ESCAPE ? q + 1U + k : FRAME_ENCODER_ESCAPE + 16U;
+    }
+    if (cost >= n * 16U)
+        k = FRAME_ENCODER_RAW;
+
+    put_bits(bw, k, 4);
+    if (k == FRAME_ENCODER_RAW) {
+        for (i = 0; i < n; i++)
+            put_bits(bw, u[i], 16);
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        uint32_t q = u[i] >> k;
+        if (q < FRAME_ENCODER_ESCAPE) {
+            put_bits(bw, ((1U << q) - 1U) << 1, q + 1U);
+            put_bits(bw, u[i] & ((1U << k) - 1U), k);
+        } else {
+            put_bits(bw, (1U << FRAME_ENCODER_ESCAPE) - 1U, FRAME_ENCODER_ESCAPE);
+            put_bits(bw, u[i], 16);
+        }
+    }
+}
+
+size_t frame_encoder_encode_row(uint8_t *dst, const uint16_t *row, unsigned width, uint16_t *prev_first)
+{
+    struct bit_writer_s bw = {dst, 0, 0};
+    uint16_t u[FRAME_ENCODER_BLOCK];
+    uint16_t pred = *prev_first;
+    unsigned x, i;
+
+    *prev_first = row[0];
+    for (x = 0; x < width; x += FRAME_ENCODER_BLOCK) {
+        unsigned n = width - x < FRAME_ENCODER_BLOCK ? width - x : FRAME_ENCODER_BLOCK;
+        for (i = 0; i < n; i++) {
+            int16_t d = (int16_t)(row[x + i] - pred);
+            u[i] = (uint16_t)((d << 1) ^ (d >> 15));
+            pred = row[x + i];
+        }
+        encode_block(&bw, u, n);
+    }
+    flush_bits(&bw);
+    return bw.p - dst;
+}
+
+static struct {
+    uint16_t width;
+    uint16_t height;
+    uint16_t prev_first;
+
+    // rows coded so far and unsent part of the last one
+    uint32_t row;
+    size_t coded_len;
+    size_t coded_pos;
+
+    // current request
+    uint32_t address;
+    uint32_t offset;
+    uint8_t *dst;
+    size_t len;
+    size_t filled;
+    FRAME_ENCODER_Callback cb;
+} encoder;
+
+static uint16_t row[FRAME_MAX_WIDTH];
+static uint8_t coded[FRAME_ENCODER_ROW_MAX(FRAME_MAX_WIDTH)];
+
+static void encoder_row_done(bool ok);
+
+static void encoder_finish(bool ok)
+{
+    bool eof = encoder.row == encoder.height && encoder.coded_pos == encoder.coded_len;
+    encoder.offset += encoder.filled;
+    // empty chunk is not a progress, pump retries it
+    if (!ok && encoder.filled == 0) {
+        encoder.cb(false, 0, false);
+        return;
+    }
+    encoder.cb(true, encoder.filled, eof);
+}
+
+static HAL_StatusTypeDef encoder_step(void)
+{
+    while (encoder.filled < encoder.len) {
+        if (encoder.coded_pos < encoder.coded_len) {
+            size_t n = encoder.coded_len - encoder.coded_pos;
+            if (n > encoder.len - encoder.filled)
+                n = encoder.len - encoder.filled;
+            memcpy(encoder.dst + encoder.filled, coded + encoder.coded_pos, n);
+            encoder.coded_pos += n;
+            encoder.filled += n;
+            continue;
+        }
+
+        if (encoder.row == encoder.height)
+            break;
+
+        uint32_t row_bytes = encoder.width * 2U;
+        HAL_StatusTypeDef res = frame_reader_read(encoder.address, encoder.row * row_bytes, (uint8_t *)row, row_bytes, encoder_row_done);
+        if (res != HAL_OK && encoder.filled > 0) {
+            // send what is coded already, the row is read again later
+            encoder_finish(true);
+            return HAL_OK;
+        }
+        return res;
+    }
+
+    encoder_finish(true);
+    return HAL_OK;
+}
+
+static void encoder_row_done(bool ok)
+{
+    if (!ok) {
+        encoder_finish(false);
+        return;
+    }
+
+    encoder.coded_len = frame_encoder_encode_row(coded, row, encoder.width, &encoder.prev_first);
+    encoder.coded_pos = 0;
+    encoder.row++;
+    if (encoder_step() != HAL_OK)
+        encoder_finish(false);
+}
+
+HAL_StatusTypeDef frame_encoder_read(uint32_t address, uint32_t offset, uint8_t *buf, size_t len, FRAME_ENCODER_Callback cb)
+{
+    if (offset == 0) {
+        frame_reader_get_size(&encoder.width, &encoder.height);
+        if (encoder.width == 0 || encoder.width > FRAME_MAX_WIDTH)
+            return HAL_ERROR;
+        encoder.address = address;
+        encoder.offset = 0;
+        encoder.row = 0;
+        encoder.coded_len = 0;
+        encoder.coded_pos = 0;
+        encoder.prev_first = 0;
+    } else if (offset != encoder.offset || address != encoder.address) {
+        // coded stream can only be continued
+        return HAL_ERROR;
+    }
+
+    encoder.dst = buf;
+    encoder.len = len;
+    encoder.filled = 0;
+    encoder.cb = cb;
+    return encoder_step();
+}
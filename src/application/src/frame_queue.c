@@ -0,0 +1,176 @@
+#include <FreeRTOS.h>
+#include <task.h>
+#include <stddef.h>
+
+#include "system_config.h"
+#include "stm32f4xx_hal.h"
+#include "frame_queue.h"
+
+/*
+ * Frame queue
+ *
+ * External SRAM is split into slots of one full frame each. Readout
+ * producer writes into a slot and queues it, USB consumer takes queued
+ * slots in order of exposure and frees them when sent. Frames stay in
+ * place, only slot descriptors change hands.
+ *
+ * Sent frames stay in SRAM until their slot is written again, free slot
+ * with the oldest frame is taken first, so host can ask for a resend of
+ * a recent frame. Pinned slots are not written.
+ *
+ * Functions are called from tasks and interrupts, slot descriptors are
+ * changed with interrupts masked.
+ */
+
+static struct {
+    struct frame_slot_s slots[FRAME_QUEUE_MAX_SLOTS];
+    unsigned num_slots;
+    uint32_t next_sequence;
+    uint32_t dropped;
+} queue;
+
+int frame_queue_init(uint16_t width, uint16_t height, uint32_t size)
+{
+    uint32_t frame_size = (uint32_t)width * height * 2U;
+    uint32_t slot_size = (frame_size + FRAME_QUEUE_SLOT_ALIGN - 1U) & ~(FRAME_QUEUE_SLOT_ALIGN - 1U);
+    if (slot_size == 0 || slot_size > size)
+        return HAL_ERROR;
+
+    queue.num_slots = size / slot_size;
+    if (queue.num_slots > FRAME_QUEUE_MAX_SLOTS)
+        queue.num_slots = FRAME_QUEUE_MAX_SLOTS;
+
+    unsigned i;
+    for (i = 0; i < queue.num_slots; i++) {
+        queue.slots[i].address = i * slot_size;
+        queue.slots[i].state = FRAME_SLOT_FREE;
+        queue.slots[i].valid = false;
+        queue.slots[i].pins = 0;
+    }
+    queue.next_sequence = 0;
+    queue.dropped = 0;
+    return HAL_OK;
+}
+
+/* Slot in given state with the lowest sequence, empty slots go first */
+static struct frame_slot_s *oldest_slot(enum frame_slot_state_e state, bool skip_pinned)
+{
+    struct frame_slot_s *oldest = NULL;
+    unsigned i;
+    for (i = 0; i < queue.num_slots; i++) {
+        struct frame_slot_s *slot = &queue.slots[i];
+        if (slot->state != state || (skip_pinned && slot->pins > 0))
+            continue;
+        if (!slot->valid)
+            return slot;
+        if (oldest == NULL || (int32_t)(slot->sequence - oldest->sequence) < 0)
+            oldest = slot;
+    }
+    return oldest;
+}
+
+/* Queued slot with the lowest sequence */
+static struct frame_slot_s *oldest_ready(void)
+{
+    return oldest_slot(FRAME_SLOT_READY, false);
+}
+
+struct frame_slot_s *frame_queue_acquire_write(void)
+{
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    struct frame_slot_s *slot = oldest_slot(FRAME_SLOT_FREE, true);
+
+    if (slot == NULL) {
+        slot = oldest_slot(FRAME_SLOT_READY, true);
+        if (slot != NULL)
+            queue.dropped++;
+    }
+
+    if (slot != NULL) {
+        slot->state = FRAME_SLOT_WRITING;
+        slot->valid = false;
+        slot->sequence = queue.next_sequence++;
+    }
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+    return slot;
+}
+
+void frame_queue_commit_write(struct frame_slot_s *slot)
+{
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    slot->state = FRAME_SLOT_READY;
+    slot->valid = true;
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+void frame_queue_abort_write(struct frame_slot_s *slot)
+{
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    slot->state = FRAME_SLOT_FREE;
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+struct frame_slot_s *frame_queue_acquire_read(void)
+{
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    struct frame_slot_s *slot = oldest_ready();
+    if (slot != NULL)
+        slot->state = FRAME_SLOT_READING;
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+    return slot;
+}
+
+bool frame_queue_acquire_read_slot(struct frame_slot_s *slot)
+{
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    bool queued = slot->state == FRAME_SLOT_READY;
+    if (queued)
+        slot->state = FRAME_SLOT_READING;
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+    return queued;
+}
+
+void frame_queue_release_read(struct frame_slot_s *slot)
+{
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    slot->state = FRAME_SLOT_FREE;
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+struct frame_slot_s *frame_queue_pin(uint32_t sequence)
+{
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    struct frame_slot_s *found = NULL;
+    unsigned i;
+    for (i = 0; i < queue.num_slots; i++) {
+        struct frame_slot_s *slot = &queue.slots[i];
+        if (slot->valid && slot->state != FRAME_SLOT_WRITING && slot->sequence == sequence) {
+            slot->pins++;
+            found = slot;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+    return found;
+}
+
+void frame_queue_unpin(struct frame_slot_s *slot)
+{
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    if (slot->pins > 0)
+        slot->pins--;
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+void frame_queue_get_stats(struct frame_queue_stats_s *stats)
+{
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+    stats->slots = queue.num_slots;
+    stats->queued = 0;
+    unsigned i;
+    for (i = 0; i < queue.num_slots; i++)
+        if (queue.slots[i].state == FRAME_SLOT_READY)
+            stats->queued++;
+    stats->dropped = queue.dropped;
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
@@ -0,0 +1,250 @@
+#include <string.h>
+
+#include "system_config.h"
+#include "frame_reader.h"
+#include "pixel_pack.h"
+#include "frame_stats.h"
+#include "defect_map.h"
+
+/*
+ * Frame reader
+ *
+ * Reads ranges of the streamed frame from FPGA SRAM into USB chunk buffers.
+ * Offsets are in the output frame, which can be binned: each output pixel
+ * is a sum of bin x bin Y16 pixels, saturated to 16 bit.
+ *
+ * Binned frame is produced row by row. Source rows are read by QSPI DMA one
+ * after another into src_row and summed into acc, the finished output row is
+ * kept in out_row, so chunks which don't align with rows are served from it.
+ *
+ * Packed 10 and 12 bit formats go through the same row path: the finished
+ * Y16 row (binned, or read directly into out_row) is packed in place.
+ *
+ * Hot pixels are corrected by defect_map in every source row before it
+ * is binned, and in direct reads.
+ *
+ * Every Y16 range produced, a finished row before packing or a direct
+ * read, is counted by frame_stats.
+ *
+ * Continuation runs from QSPI DMA interrupt.
+ */
+
+static struct {
+    uint16_t width;
+    uint16_t height;
+    unsigned binning;
+    unsigned bits;
+
+    // current request
+    uint32_t address;
+    uint32_t offset;
+    uint8_t *dst;
+    size_t remaining;
+    QUADSPI_ReadCallback cb;
+
+    // direct Y16 read, counted when it is done
+    uint8_t *direct_buf;
+    uint32_t direct_offset;
+    size_t direct_len;
+
+    // binned row being accumulated and the last completed one
+    uint32_t acc_row;
+    unsigned acc_lines;
+    int32_t out_row_index;
+} reader;
+
+static uint16_t src_row[FRAME_MAX_WIDTH];
+static uint32_t acc[FRAME_MAX_WIDTH / 2];
+static uint16_t out_row[FRAME_MAX_WIDTH];
+
+static void reader_src_row_done(bool ok);
+
+void frame_reader_init(uint16_t width, uint16_t height)
+{
+    reader.width = width;
+    reader.height = height;
+    reader.binning = 1;
+    reader.bits = 16;
+    reader.out_row_index = -1;
+}
+
+static bool row_fits(unsigned binning, unsigned bits)
+{
+    unsigned out_width = reader.width / binning;
+    if ((binning != 1 || bits != 16) && reader.width > FRAME_MAX_WIDTH)
+        return false;
+    if (bits == 12)
+        return out_width % PIXEL_PACK_Y12P_GROUP == 0;
+    if (bits == 10)
+        return out_width % PIXEL_PACK_Y10P_GROUP == 0;
+    return true;
+}
+
+int frame_reader_set_binning(unsigned binning)
+{
+    if (binning != 1 && binning != 2 && binning != 4)
+        return HAL_ERROR;
+    if (!row_fits(binning, 16))
+        return HAL_ERROR;
+
+    // packing depends on row width, it is set again after binning
+    reader.binning = binning;
+    reader.bits = 16;
+    reader.out_row_index = -1;
+    return HAL_OK;
+}
+
+int frame_reader_set_packing(unsigned bits)
+{
+    if (bits != 16 && bits != 12 && bits != 10)
+        return HAL_ERROR;
+    if (!row_fits(reader.binning, bits))
+        return HAL_ERROR;
+
+    reader.bits = bits;
+    reader.out_row_index = -1;
+    return HAL_OK;
+}
+
+void frame_reader_get_size(uint16_t *width, uint16_t *height)
+{
+    *width = reader.width / reader.binning;
+    *height = reader.height / reader.binning;
+}
+
+bool frame_reader_is_direct(void)
+{
+    return reader.binning == 1 && reader.bits == 16;
+}
+
+static uint32_t out_row_bytes(void)
+{
+    return (reader.width / reader.binning) * reader.bits / 8U;
+}
+
+static HAL_StatusTypeDef reader_read_src_line(void)
+{
+    uint32_t line = reader.acc_row * reader.binning + reader.acc_lines;
+    uint32_t address = reader.address + line * reader.width * 2U;
+    // unbinned row needs no accumulation
+    uint16_t *dst = reader.binning == 1 ? out_row : src_row;
+    return QUADSPI_Read_DMA(address, (uint8_t *)dst, reader.width * 2U, reader_src_row_done);
+}
+
+static void reader_accumulate(void)
+{
+    unsigned out_width = reader.width / reader.binning;
+    unsigned x, i;
+    const uint16_t *src = src_row;
+
+    if (reader.binning == 2) {
+        for (x = 0; x < out_width; x++, src += 2)
+            acc[x] += src[0] + src[1];
+    } else {
+        for (x = 0; x < out_width; x++, src += reader.binning)
+            for (i = 0; i < reader.binning; i++)
+                acc[x] += src[i];
+    }
+}
+
+static void reader_finish_row(void)
+{
+    unsigned out_width = reader.width / reader.binning;
+    unsigned x;
+    if (reader.binning != 1) {
+        for (x = 0; x < out_width; x++)
+            out_row[x] = acc[x] > 0xFFFFU ? 0xFFFFU : acc[x];
+    }
+    frame_stats_add(reader.acc_row * out_width, out_row, out_width);
+
+    if (reader.bits == 12)
+        pack_y12p((uint8_t *)out_row, out_row, out_width);
+    else if (reader.bits == 10)
+        pack_y10p((uint8_t *)out_row, out_row, out_width);
+    reader.out_row_index = reader.acc_row;
+}
+
+/*
+ * Serve request from the completed row, start reading the next one
+ * when needed. Returns HAL_OK when request is completed or pending.
+ */
+static HAL_StatusTypeDef reader_step(void)
+{
+    uint32_t row_bytes = out_row_bytes();
+    while (reader.remaining > 0) {
+        uint32_t row = reader.offset / row_bytes;
+        if ((int32_t)row == reader.out_row_index) {
+            uint32_t col = reader.offset % row_bytes;
+            size_t n = row_bytes - col;
+            if (n > reader.remaining)
+                n = reader.remaining;
+            memcpy(reader.dst, (uint8_t *)out_row + col, n);
+            reader.dst += n;
+            reader.offset += n;
+            reader.remaining -= n;
+            continue;
+        }
+
+        reader.acc_row = row;
+        reader.acc_lines = 0;
+        if (reader.binning != 1)
+            memset(acc, 0, (reader.width / reader.binning) * sizeof(acc[0]));
+        return reader_read_src_line();
+    }
+
+    reader.cb(true);
+    return HAL_OK;
+}
+
+static void reader_src_row_done(bool ok)
+{
+    if (!ok) {
+        reader.cb(false);
+        return;
+    }
+
+    uint32_t line = reader.acc_row * reader.binning + reader.acc_lines;
+    defect_map_apply(line * reader.width, reader.binning == 1 ? out_row : src_row, reader.width);
+    if (reader.binning != 1)
+        reader_accumulate();
+    reader.acc_lines++;
+    HAL_StatusTypeDef res;
+    if (reader.acc_lines < reader.binning) {
+        res = reader_read_src_line();
+    } else {
+        reader_finish_row();
+        res = reader_step();
+    }
+    if (res != HAL_OK)
+        reader.cb(false);
+}
+
+static void reader_direct_done(bool ok)
+{
+    // pixels split between chunks are not counted, frame is incomplete then
+    if (ok && reader.direct_offset % 2U == 0 && reader.direct_len % 2U == 0) {
+        defect_map_apply(reader.direct_offset / 2U, (uint16_t *)reader.direct_buf, reader.direct_len / 2U);
+        frame_stats_add(reader.direct_offset / 2U, (const uint16_t *)reader.direct_buf, reader.direct_len / 2U);
+    }
+    reader.cb(ok);
+}
+
+HAL_StatusTypeDef frame_reader_read(uint32_t address, uint32_t offset, uint8_t *buf, size_t len, QUADSPI_ReadCallback cb)
+{
+    if (frame_reader_is_direct()) {
+        reader.direct_buf = buf;
+        reader.direct_offset = offset;
+        reader.direct_len = len;
+        reader.cb = cb;
+        return QUADSPI_Read_DMA(address + offset, buf, len, reader_direct_done);
+    }
+
+    if (reader.address != address)
+        reader.out_row_index = -1;
+    reader.address = address;
+    reader.offset = offset;
+    reader.dst = buf;
+    reader.remaining = len;
+    reader.cb = cb;
+    return reader_step();
+}
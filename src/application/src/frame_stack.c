@@ -0,0 +1,166 @@
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "system_config.h"
+#include "usbd_conf.h"
+#include "usb_device.h"
+#include "frame_stack.h"
+#include "hw/quadspi.h"
+
+static struct {
+    uint32_t pixels;
+    uint32_t sum_address;
+    uint32_t min_address;
+    uint32_t max_address;
+
+    // settings, changed from USB interrupt
+    unsigned depth;
+    unsigned flags;
+    unsigned shift;
+    volatile bool restart;
+
+    // stack in progress
+    unsigned count;
+    uint32_t pts;
+    uint64_t exposure;
+} stack;
+
+static uint16_t pixels[FRAME_STACK_BLOCK];
+static uint32_t sum[FRAME_STACK_BLOCK];
+static uint16_t min[FRAME_STACK_BLOCK];
+static uint16_t max[FRAME_STACK_BLOCK];
+
+uint32_t frame_stack_init(uint16_t width, uint16_t height)
+{
+    stack.pixels = (uint32_t)width * height;
+    uint32_t size = stack.pixels * 8U;
+    size = (size + FRAME_QUEUE_SLOT_ALIGN - 1U) & ~(FRAME_QUEUE_SLOT_ALIGN - 1U);
+    stack.sum_address = SRAM_SIZE - size;
+    stack.min_address = stack.sum_address + stack.pixels * 4U;
+    stack.max_address = stack.min_address + stack.pixels * 2U;
+    stack.depth = 0;
+    stack.count = 0;
+    return size;
+}
+
+int frame_stack_set(unsigned depth, unsigned flags, unsigned shift)
+{
+    if (depth > 0xFFFFU || shift > VC_STACK_MAX_SHIFT || (flags & ~VC_STACK_REJECT_MINMAX) != 0)
+        return -1;
+    // rejection keeps at least one readout
+    if ((flags & VC_STACK_REJECT_MINMAX) && depth < 3U)
+        return -1;
+    stack.depth = depth;
+    stack.flags = flags;
+    stack.shift = shift;
+    stack.restart = true;
+    return 0;
+}
+
+void frame_stack_get(unsigned *depth, unsigned *flags, unsigned *shift)
+{
+    *depth = stack.depth;
+    *flags = stack.flags;
+    *shift = stack.shift;
+}
+
+bool frame_stack_active(void)
+{
+    return stack.depth > 1U;
+}
+
+static bool read_block(uint32_t address, void *buf, uint32_t size)
+{
+    return QUADSPI_TaskRead(address, buf, size) == HAL_OK;
+}
+
+static bool write_block(uint32_t address, const void *buf, uint32_t size)
+{
+    return QUADSPI_TaskWrite(address, buf, size) == HAL_OK;
+}
+
+bool frame_stack_add(struct frame_slot_s *slot)
+{
+    unsigned depth, reject, shift, i;
+    uint32_t offset;
+
+    taskENTER_CRITICAL();
+    if (stack.restart) {
+        stack.restart = false;
+        stack.count = 0;
+    }
+    depth = stack.depth;
+    reject = stack.flags & VC_STACK_REJECT_MINMAX;
+    shift = stack.shift;
+    taskEXIT_CRITICAL();
+
+    bool first = stack.count == 0;
+    bool last = stack.count + 1U >= depth;
+
+    for (offset = 0; offset < stack.pixels; offset += FRAME_STACK_BLOCK) {
+        unsigned n = stack.pixels - offset;
+        if (n > FRAME_STACK_BLOCK)
+            n = FRAME_STACK_BLOCK;
+
+        if (!read_block(slot->address + offset * 2U, pixels, n * 2U))
+            goto error;
+        if (first) {
+            for (i = 0; i < n; i++)
+                sum[i] = min[i] = max[i] = pixels[i];
+        } else {
+            if (!read_block(stack.sum_address + offset * 4U, sum, n * 4U))
+                goto error;
+            if (reject && (!read_block(stack.min_address + offset * 2U, min, n * 2U) ||
+                           !read_block(stack.max_address + offset * 2U, max, n * 2U)))
+                goto error;
+            for (i = 0; i < n; i++) {
+                uint16_t p = pixels[i];
+                sum[i] += p;
+                if (p < min[i])
+                    min[i] = p;
+                if (p > max[i])
+                    max[i] = p;
+            }
+        }
+
+        if (last) {
+            for (i = 0; i < n; i++) {
+                uint32_t s = sum[i];
+                if (reject)
+                    s -= min[i] + max[i];
+                s >>= shift;
+                pixels[i] = s > 0xFFFFU ? 0xFFFFU : s;
+            }
+            if (!write_block(slot->address + offset * 2U, pixels, n * 2U))
+                goto error;
+            continue;
+        }
+
+        if (!write_block(stack.sum_address + offset * 4U, sum, n * 4U))
+            goto error;
+        if (reject && (!write_block(stack.min_address + offset * 2U, min, n * 2U) ||
+                       !write_block(stack.max_address + offset * 2U, max, n * 2U)))
+            goto error;
+    }
+
+    if (first) {
+        stack.pts = slot->pts;
+        stack.exposure = 0;
+    }
+    stack.exposure += slot->exposure;
+    if (!last) {
+        stack.count++;
+        return false;
+    }
+
+    slot->pts = stack.pts;
+    slot->exposure = stack.exposure;
+    slot->flags |= FRAME_METADATA_STACKED;
+    stack.count = 0;
+    return true;
+
+error:
+    // accumulator is left half updated
+    stack.count = 0;
+    return false;
+}
@@ -0,0 +1,128 @@
+#ifndef STM32F446xx
+#define STM32F446xx
+#endif
+
+#include <string.h>
+
+#include "stm32f446xx.h"
+#include "frame_stats.h"
+
+/*
+ * Two pixels are handled per 32-bit word with DSP instructions. USUB16
+ * sets GE flags of both halfwords and SEL picks halfwords by them, which
+ * gives min, max and saturation of both pixels without branches.
+ * Saturated pixels are counted per halfword with UQADD16. UXTB16 on the
+ * word rotated by 8 gives high bytes of both pixels, they index the
+ * histogram, USADA8 adds them to the sum. Low bytes go the same way.
+ *
+ * Frame is accumulated in one of two buffers while the other one holds
+ * the last completed frame. Both start and add run from interrupts of
+ * the same priority as the reader of the statistics (USB and QSPI DMA).
+ */
+
+// halfword counters of saturated pixels can't overflow within a block
+#define STATS_BLOCK_PAIRS 0xFFFFU
+
+static struct frame_stats_s buffers[2];
+static struct frame_stats_s *last = &buffers[1];
+static struct frame_stats_s *acc = &buffers[0];
+static uint32_t next_offset;
+
+static inline uint32_t load_pair(const uint16_t *src)
+{
+    uint32_t w;
+    memcpy(&w, src, sizeof(w));
+    return w;
+}
+
+void frame_stats_start(const struct frame_slot_s *slot, uint32_t pixels)
+{
+    memset(acc, 0, sizeof(*acc));
+    acc->sequence = slot->sequence;
+    acc->exposure = slot->exposure;
+    acc->gain = slot->gain;
+    acc->pixels = pixels;
+    acc->min = 0xFFFFU;
+    next_offset = 0;
+}
+
+static void add_pixel(uint16_t p)
+{
+    if (p < acc->min)
+        acc->min = p;
+    if (p > acc->max)
+        acc->max = p;
+    if (p >= FRAME_STATS_SATURATION)
+        acc->saturated++;
+    acc->sum += p;
+    acc->histogram[p >> 8]++;
+}
+
+static void add_block(const uint16_t *pixels, size_t pairs)
+{
+    const uint32_t sat = FRAME_STATS_SATURATION * 0x00010001U;
+    uint32_t min = acc->min * 0x00010001U;
+    uint32_t max = acc->max * 0x00010001U;
+    uint32_t nsat = 0;
+    uint32_t sum_high = 0;
+    uint32_t sum_low = 0;
+    uint32_t *hist = acc->histogram;
+    size_t i;
+
+    for (i = 0; i < pairs; i++) {
+        uint32_t w = load_pair(pixels + 2 * i);
+        uint32_t h = __UXTB16(__ROR(w, 8));
+
+        __USUB16(w, max);
+        max = __SEL(w, max);
+        __USUB16(min, w);
+        min = __SEL(w, min);
+        __USUB16(w, sat);
+        nsat = __UQADD16(nsat, __SEL(0x00010001U, 0U));
+
+        hist[h & 0xFFU]++;
+        hist[h >> 16]++;
+        sum_high = __USADA8(h, 0U, sum_high);
+        sum_low = __USADA8(__UXTB16(w), 0U, sum_low);
+    }
+
+    uint16_t min_lo = min & 0xFFFFU, min_hi = min >> 16;
+    uint16_t max_lo = max & 0xFFFFU, max_hi = max >> 16;
+    acc->min = min_lo < min_hi ? min_lo : min_hi;
+    acc->max = max_lo > max_hi ? max_lo : max_hi;
+    acc->saturated += (nsat & 0xFFFFU) + (nsat >> 16);
+    acc->sum += ((uint64_t)sum_high << 8) + sum_low;
+}
+
+void frame_stats_add(uint32_t offset, const uint16_t *pixels, size_t n)
+{
+    if (offset != next_offset || offset >= acc->pixels)
+        return;
+    if (n > acc->pixels - offset)
+        n = acc->pixels - offset;
+    next_offset += n;
+
+    while (n >= 2) {
+        size_t pairs = n / 2;
+        if (pairs > STATS_BLOCK_PAIRS)
+            pairs = STATS_BLOCK_PAIRS;
+        add_block(pixels, pairs);
+        pixels += 2 * pairs;
+        n -= 2 * pairs;
+    }
+    if (n > 0)
+        add_pixel(*pixels);
+
+    if (next_offset == acc->pixels) {
+        acc->mean = (acc->sum + acc->pixels / 2U) / acc->pixels;
+        struct frame_stats_s *done = acc;
+        acc = last;
+        last = done;
+        next_offset = 0xFFFFFFFFU;
+    }
+}
+
+const struct frame_stats_s *frame_stats_get(void)
+{
+    return last;
+}
@@ -0,0 +1,129 @@
+#include <string.h>
+#include <math.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "guide.h"
+#include "hw/quadspi.h"
+
+static struct {
+    uint16_t width;
+    uint16_t height;
+    unsigned count;
+    unsigned size;
+    uint16_t centers[CAMERA_GUIDE_MAX_ROIS][2];
+} guide;
+
+static uint16_t window[CAMERA_GUIDE_MAX_ROI_SIZE * CAMERA_GUIDE_MAX_ROI_SIZE];
+
+void guide_init(uint16_t width, uint16_t height)
+{
+    guide.width = width;
+    guide.height = height;
+    guide.count = 0;
+}
+
+int guide_set_rois(unsigned count, unsigned size, uint16_t centers[][2])
+{
+    unsigned i;
+    if (count > CAMERA_GUIDE_MAX_ROIS)
+        return -1;
+    if (count > 0 && (size < GUIDE_MIN_ROI_SIZE || size > CAMERA_GUIDE_MAX_ROI_SIZE || size % 2U != 0))
+        return -1;
+    for (i = 0; i < count; i++) {
+        // window must be inside of the frame
+        if (centers[i][0] < size / 2U || centers[i][0] + size / 2U > guide.width)
+            return -1;
+        if (centers[i][1] < size / 2U || centers[i][1] + size / 2U > guide.height)
+            return -1;
+    }
+
+    guide.count = 0;
+    guide.size = size;
+    memcpy(guide.centers, centers, count * sizeof(guide.centers[0]));
+    guide.count = count;
+    return 0;
+}
+
+void guide_get_rois(unsigned *count, unsigned *size, uint16_t centers[][2])
+{
+    *count = guide.count;
+    *size = guide.size;
+    memcpy(centers, guide.centers, sizeof(guide.centers));
+}
+
+bool guide_active(void)
+{
+    return guide.count > 0;
+}
+
+static void measure_star(unsigned size, unsigned x0, unsigned y0, struct guide_star_s *star)
+{
+    unsigned x, y;
+    uint32_t n = 0;
+    uint64_t sum = 0, sum2 = 0;
+
+    // background from the border
+    for (y = 0; y < size; y++) {
+        unsigned step = (y == 0 || y == size - 1U) ? 1U : size - 1U;
+        for (x = 0; x < size; x += step) {
+            uint32_t p = window[y * size + x];
+            sum += p;
+            sum2 += p * p;
+            n++;
+        }
+    }
+    float bg = (float)sum / n;
+    float var = (float)sum2 / n - bg * bg;
+    float noise = var > 0.0f ? sqrtf(var) : 0.0f;
+    float threshold = bg + GUIDE_THRESHOLD_SIGMA * noise;
+
+    float flux = 0.0f, fx = 0.0f, fy = 0.0f;
+    unsigned npix = 0;
+    for (y = 0; y < size; y++) {
+        for (x = 0; x < size; x++) {
+            float p = window[y * size + x];
+            if (p <= threshold)
+                continue;
+            float w = p - bg;
+            flux += w;
+            fx += w * x;
+            fy += w * y;
+            npix++;
+        }
+    }
+
+    memset(star, 0, sizeof(*star));
+    star->background = bg + 0.5f;
+    if (flux <= 0.0f)
+        return;
+    star->x = (x0 + fx / flux) * 256.0f + 0.5f;
+    star->y = (y0 + fy / flux) * 256.0f + 0.5f;
+    star->flux = flux + 0.5f;
+    float snr = flux / sqrtf(flux + npix * var) * 16.0f;
+    star->snr = snr > 65535.0f ? 65535U : (uint16_t)snr;
+}
+
+unsigned guide_measure(const struct frame_slot_s *slot, struct guide_report_s *report)
+{
+    unsigned count, size, i, y;
+    uint16_t centers[CAMERA_GUIDE_MAX_ROIS][2];
+
+    taskENTER_CRITICAL();
+    guide_get_rois(&count, &size, centers);
+    taskEXIT_CRITICAL();
+
+    report->sequence = slot->sequence;
+    report->exposure_start = slot->pts;
+    for (i = 0; i < count; i++) {
+        unsigned x0 = centers[i][0] - size / 2U;
+        unsigned y0 = centers[i][1] - size / 2U;
+        for (y = 0; y < size; y++) {
+            uint32_t address = slot->address + ((y0 + y) * guide.width + x0) * 2U;
+            if (QUADSPI_TaskRead(address, (uint8_t *)&window[y * size], size * 2U) != HAL_OK)
+                return i;
+        }
+        measure_star(size, x0, y0, &report->stars[i]);
+    }
+    return count;
+}
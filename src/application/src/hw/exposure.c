@@ -0,0 +1,154 @@
+#ifndef STM32F446xx
+#define STM32F446xx
+#endif
+
+#include "system_config.h"
+#include "stm32f446xx.h"
+#include "stm32f4xx_hal.h"
+#include "hw/exposure.h"
+
+TIM_HandleTypeDef htim5;
+
+/*
+ * TIM5 is 32-bit and runs in one pulse mode with PWM mode 2 on CH1:
+ * SHUTTER pin goes active when counter reaches CCR1 and inactive on update,
+ * where counter stops. Both edges are made by the timer, so exposure time
+ * does not depend on interrupt or task latency, interrupt only reports the
+ * end of exposure.
+ *
+ * For external trigger the timer is loaded in advance and counter is set
+ * right to CCR1 on trigger, so SHUTTER goes active on that register write,
+ * not a tick later.
+ *
+ * At EXPOSURE_FREQ one pulse is up to 2^32 us, about 71 minutes. Longer
+ * exposures are counted with tick of several microseconds, rounding error
+ * is below 1 ppm of such exposure.
+ */
+
+#define EXPOSURE_LEAD 1U        // ticks from start to active edge
+
+static volatile EXPOSURE_Callback exposure_cb;
+static uint32_t timer_clk;
+
+int EXPOSURE_Init(void)
+{
+    __HAL_RCC_TIM5_CLK_ENABLE();
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    GPIO_InitStruct.Pin = SHUTTER_Pin;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF2_TIM5;
+    HAL_GPIO_Init(SHUTTER_GPIO_Port, &GPIO_InitStruct);
+
+    // APB1 timers are clocked at twice PCLK1 when APB1 is divided
+    timer_clk = HAL_RCC_GetPCLK1Freq() * 2U;
+
+    htim5.Instance = TIM5;
+    htim5.Init.Prescaler = timer_clk / EXPOSURE_FREQ - 1U;
+    htim5.Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim5.Init.Period = 0xFFFFFFFFU;
+    htim5.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    htim5.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+    if (HAL_TIM_OnePulse_Init(&htim5, TIM_OPMODE_SINGLE) != HAL_OK)
+        return HAL_ERROR;
+
+    TIM_OC_InitTypeDef oc = {0};
+    oc.OCMode = TIM_OCMODE_PWM2;
+    oc.Pulse = EXPOSURE_LEAD;
+    oc.OCPolarity = TIM_OCPOLARITY_HIGH;
+    oc.OCFastMode = TIM_OCFAST_DISABLE;
+    if (HAL_TIM_PWM_ConfigChannel(&htim5, &oc, TIM_CHANNEL_1) != HAL_OK)
+        return HAL_ERROR;
+
+    // only counter overflow is an update interrupt, not loading of exposure
+    htim5.Instance->CR1 |= TIM_CR1_URS;
+    // counter is below CCR1 while stopped, so pin is inactive
+    TIM_CCxChannelCmd(htim5.Instance, TIM_CHANNEL_1, TIM_CCx_ENABLE);
+    __HAL_TIM_CLEAR_IT(&htim5, TIM_IT_UPDATE);
+    __HAL_TIM_ENABLE_IT(&htim5, TIM_IT_UPDATE);
+
+    HAL_NVIC_SetPriority(TIM5_IRQn, EXPOSURE_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(TIM5_IRQn);
+    return HAL_OK;
+}
+
+bool EXPOSURE_Busy(void)
+{
+    return (htim5.Instance->CR1 & TIM_CR1_CEN) != 0;
+}
+
+/* Load exposure into stopped timer */
+static uint64_t load(uint64_t duration, EXPOSURE_Callback cb)
+{
+    if (EXPOSURE_Busy())
+        return 0;
+
+    // microseconds per tick
+    uint32_t k = (uint32_t)(duration / 0xFFFFFFFFU) + 1U;
+    uint32_t prescaler = timer_clk / EXPOSURE_FREQ * k - 1U;
+    if (prescaler > 0xFFFFU)
+        return 0;
+    uint32_t ticks = (uint32_t)((duration + k / 2U) / k);
+    if (ticks == 0)
+        ticks = 1;
+
+    __HAL_TIM_SET_PRESCALER(&htim5, prescaler);
+    __HAL_TIM_SET_AUTORELOAD(&htim5, EXPOSURE_LEAD + ticks - 1U);
+    __HAL_TIM_SET_COMPARE(&htim5, TIM_CHANNEL_1, EXPOSURE_LEAD);
+    __HAL_TIM_SET_COUNTER(&htim5, 0);
+    // load prescaler and CCR1 preload now
+    htim5.Instance->EGR = TIM_EGR_UG;
+
+    exposure_cb = cb;
+    return (uint64_t)ticks * k;
+}
+
+uint64_t EXPOSURE_Start(uint64_t duration, EXPOSURE_Callback cb)
+{
+    uint64_t exposure = load(duration, cb);
+    if (exposure != 0)
+        __HAL_TIM_ENABLE(&htim5);
+    return exposure;
+}
+
+uint64_t EXPOSURE_Arm(uint64_t duration, EXPOSURE_Callback cb)
+{
+    return load(duration, cb);
+}
+
+void EXPOSURE_Fire(void)
+{
+    htim5.Instance->CNT = EXPOSURE_LEAD;
+    htim5.Instance->CR1 |= TIM_CR1_CEN;
+}
+
+void EXPOSURE_Stop(void)
+{
+    // update event resets counter and stops it in one pulse mode,
+    // with URS cleared it also raises update interrupt to report the end
+    htim5.Instance->CR1 &= ~TIM_CR1_URS;
+    htim5.Instance->EGR = TIM_EGR_UG;
+    htim5.Instance->CR1 |= TIM_CR1_URS;
+}
+
+void EXPOSURE_Abort(void)
+{
+    exposure_cb = NULL;
+    // __HAL_TIM_DISABLE does not stop timer with enabled channel
+    htim5.Instance->CR1 &= ~TIM_CR1_CEN;
+    __HAL_TIM_SET_COUNTER(&htim5, 0);
+}
+
+void TIM5_IRQHandler(void)
+{
+    if (__HAL_TIM_GET_FLAG(&htim5, TIM_FLAG_UPDATE) != RESET) {
+        __HAL_TIM_CLEAR_IT(&htim5, TIM_IT_UPDATE);
+        EXPOSURE_Callback cb = exposure_cb;
+        exposure_cb = NULL;
+        if (cb != NULL)
+            cb();
+    }
+}
@@ -39,11 +39,7 @@ int FPGA_CTL_Init(void)
     GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
     HAL_GPIO_Init(COMMAND_INT_GPIO_Port, &GPIO_InitStruct);
 
-    GPIO_InitStruct.Pin = COMMAND_TRG_Pin;
-    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
-    GPIO_InitStruct.Pull = GPIO_PULLUP;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-    HAL_GPIO_Init(COMMAND_TRG_GPIO_Port, &GPIO_InitStruct);
+    // COMMAND_TRG is external trigger interrupt, see TRIGGER_Init
 
     return HAL_OK;
 }
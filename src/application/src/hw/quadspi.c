@@ -11,10 +11,33 @@
 #include <stdint.h>
 #include <task.h>
 #include <timers.h>
+#include <semphr.h>
 
 #define HARD_QPI 1
 
+// task reads and writes wait for stream reads this long
+#define QUADSPI_TASK_RETRIES        10U
+#define QUADSPI_TASK_TIMEOUT_MS     100U
+// write piece by DMA, stream reads get QSPI between pieces
+#define QUADSPI_TASK_WRITE_BLOCK    256U
+
+// FSIZE: 2^(FSIZE+1) bytes are addressed, memory-mapped reads above are bus errors
+#define QUADSPI_FLASH_SIZE          23U
+
+// frame queue slots and stack sums lie in first SRAM_SIZE bytes
+_Static_assert(SRAM_SIZE <= (1UL << (QUADSPI_FLASH_SIZE + 1U)), "frame SRAM does not fit QSPI address range");
+
 QSPI_HandleTypeDef hqspi;
+DMA_HandleTypeDef hdma_quadspi;
+
+static QUADSPI_ReadCallback dma_cb;    // read or write by DMA is running
+
+static StaticSemaphore_t task_lock_buffer;
+static SemaphoreHandle_t task_lock;
+static StaticSemaphore_t task_done_buffer;
+static SemaphoreHandle_t task_done;
+static volatile bool task_ok;
+static volatile bool task_pending;  // task transfer waits, SRAM is not mapped again
 
 void HAL_QSPI_MspInit(QSPI_HandleTypeDef* qspiHandle)
 {
@@ -68,38 +91,77 @@ void HAL_QSPI_MspInit(QSPI_HandleTypeDef* qspiHandle)
         GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
         GPIO_InitStruct.Alternate = GPIO_AF9_QSPI;
         HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+        /* QUADSPI DMA -> DMA2 Stream 7 Channel 3 */
+        __HAL_RCC_DMA2_CLK_ENABLE();
+        hdma_quadspi.Instance = DMA2_Stream7;
+        hdma_quadspi.Init.Channel = DMA_CHANNEL_3;
+        hdma_quadspi.Init.Direction = DMA_PERIPH_TO_MEMORY;
+        hdma_quadspi.Init.PeriphInc = DMA_PINC_DISABLE;
+        hdma_quadspi.Init.MemInc = DMA_MINC_ENABLE;
+        hdma_quadspi.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        hdma_quadspi.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+        hdma_quadspi.Init.Mode = DMA_NORMAL;
+        hdma_quadspi.Init.Priority = DMA_PRIORITY_HIGH;
+        hdma_quadspi.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+        HAL_DMA_Init(&hdma_quadspi);
+        __HAL_LINKDMA(qspiHandle, hdma, hdma_quadspi);
+
+        /*
+         * Same priority as OTG_HS: DMA completion feeds the UVC endpoint
+         * and must not preempt the USB interrupt (and vice versa)
+         */
+        HAL_NVIC_SetPriority(DMA2_Stream7_IRQn, STREAM_IRQ_PRIORITY, 0);
+        HAL_NVIC_EnableIRQ(DMA2_Stream7_IRQn);
+        HAL_NVIC_SetPriority(QUADSPI_IRQn, STREAM_IRQ_PRIORITY, 0);
+        HAL_NVIC_EnableIRQ(QUADSPI_IRQn);
     }
 }
 
-int QSPI_EnableMemoryMapped(void)
+void QUADSPI_IRQHandler(void)
 {
-    QSPI_CommandTypeDef cmd = {0};
-    QSPI_MemoryMappedTypeDef memMappedCfg = {0};
+    HAL_QSPI_IRQHandler(&hqspi);
+}
 
-    cmd.InstructionMode   = QSPI_INSTRUCTION_1_LINE;
-    cmd.Instruction       = 0xEB;  // Fast Read (with dummy cycles)
-    cmd.AddressMode       = QSPI_ADDRESS_1_LINE;
-    cmd.AddressSize       = QSPI_ADDRESS_32_BITS;
-    cmd.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
-    cmd.DataMode          = QSPI_DATA_1_LINE;  // Single data output
-    cmd.DummyCycles       = 8;
-    cmd.DdrMode           = QSPI_DDR_MODE_DISABLE;
-    cmd.DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
-    cmd.SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
+void DMA2_Stream7_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&hdma_quadspi);
+}
 
-    memMappedCfg.TimeOutActivation = QSPI_TIMEOUT_COUNTER_DISABLE;
+void HAL_QSPI_RxCpltCallback(QSPI_HandleTypeDef *qspiHandle)
+{
+    QUADSPI_ReadCallback cb = dma_cb;
+    dma_cb = NULL;
+    if (cb != NULL)
+        cb(true);
+}
 
-    return HAL_QSPI_MemoryMapped(&hqspi, &cmd, &memMappedCfg);
+void HAL_QSPI_TxCpltCallback(QSPI_HandleTypeDef *qspiHandle)
+{
+    QUADSPI_ReadCallback cb = dma_cb;
+    dma_cb = NULL;
+    if (cb != NULL)
+        cb(true);
+}
+
+void HAL_QSPI_ErrorCallback(QSPI_HandleTypeDef *qspiHandle)
+{
+    QUADSPI_ReadCallback cb = dma_cb;
+    dma_cb = NULL;
+    if (cb != NULL)
+        cb(false);
 }
 
 int QUADSPI_Init(void)
 {
+    task_lock = xSemaphoreCreateMutexStatic(&task_lock_buffer);
+    task_done = xSemaphoreCreateBinaryStatic(&task_done_buffer);
 #if HARD_QPI
     hqspi.Instance = QUADSPI;
     hqspi.Init.ClockPrescaler     = 255;          // fQSPI = fAHB / (1 + ClockPrescaler)
     hqspi.Init.FifoThreshold      = 4;
     hqspi.Init.SampleShifting     = QSPI_SAMPLE_SHIFTING_HALFCYCLE;
-    hqspi.Init.FlashSize          = POSITION_VAL(SRAM_SIZE + FPGA_FLASH_SIZE) - 1; // 16 MB + 512 KB
+    hqspi.Init.FlashSize          = QUADSPI_FLASH_SIZE; // 16 MB, 24 bit addresses
     hqspi.Init.ChipSelectHighTime = QSPI_CS_HIGH_TIME_1_CYCLE;
     hqspi.Init.ClockMode          = QSPI_CLOCK_MODE_0;
     hqspi.Init.FlashID            = QSPI_FLASH_ID_1;
@@ -168,23 +230,85 @@ static uint8_t transferByte(uint8_t out)
     return rcv;
 }
 
+#if HARD_QPI
+static void fill_read_command(QSPI_CommandTypeDef *sCommand, uint32_t address, uint32_t size)
+{
+    sCommand->InstructionMode   = QSPI_INSTRUCTION_1_LINE;
+    sCommand->Instruction       = 0x03;                   // READ command
+    sCommand->AddressMode       = QSPI_ADDRESS_1_LINE;
+    sCommand->AddressSize       = QSPI_ADDRESS_24_BITS;
+    sCommand->Address           = address;
+    sCommand->AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+    sCommand->DataMode          = QSPI_DATA_1_LINE;
+    sCommand->DummyCycles       = 8;
+    sCommand->NbData            = size;
+    sCommand->DdrMode           = QSPI_DDR_MODE_DISABLE;
+    sCommand->DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
+    sCommand->SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
+}
+
+static void fill_write_command(QSPI_CommandTypeDef *sCommand, uint32_t address, uint32_t size)
+{
+    sCommand->InstructionMode   = QSPI_INSTRUCTION_1_LINE;
+    sCommand->Instruction       = 0x02;                   // WRITE command
+    sCommand->AddressMode       = QSPI_ADDRESS_1_LINE;
+    sCommand->AddressSize       = QSPI_ADDRESS_24_BITS;
+    sCommand->Address           = address;
+    sCommand->AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+    sCommand->DataMode          = QSPI_DATA_1_LINE;
+    sCommand->DummyCycles       = 0;
+    sCommand->NbData            = size;
+    sCommand->DdrMode           = QSPI_DDR_MODE_DISABLE;
+    sCommand->DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
+    sCommand->SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
+}
+#endif
+
+/*
+ * Memory-mapped mode: FPGA SRAM is read by the bus at QUADSPI_MAPPED_BASE
+ * with the same READ command as indirect reads. Indirect commands fail
+ * with HAL_BUSY until it is disabled again, so callers hold it only while
+ * a transfer from the mapped region is running. A waiting task transfer
+ * goes first, USB would map it again right after each transfer otherwise.
+ */
+int QSPI_EnableMemoryMapped(void)
+{
+#if HARD_QPI
+    QSPI_CommandTypeDef cmd = {0};
+    QSPI_MemoryMappedTypeDef memMappedCfg = {0};
+
+    if (HAL_QSPI_GetState(&hqspi) == HAL_QSPI_STATE_BUSY_MEM_MAPPED)
+        return HAL_OK;
+    if (task_pending)
+        return HAL_BUSY;
+
+    fill_read_command(&cmd, 0, 0);
+    // nCS goes high when the bus stops reading, SRAM is not held selected
+    memMappedCfg.TimeOutActivation = QSPI_TIMEOUT_COUNTER_ENABLE;
+    memMappedCfg.TimeOutPeriod = 16;
+
+    return HAL_QSPI_MemoryMapped(&hqspi, &cmd, &memMappedCfg);
+#else
+    return HAL_ERROR;
+#endif
+}
+
+int QSPI_DisableMemoryMapped(void)
+{
+#if HARD_QPI
+    if (HAL_QSPI_GetState(&hqspi) != HAL_QSPI_STATE_BUSY_MEM_MAPPED)
+        return HAL_OK;
+    return HAL_QSPI_Abort(&hqspi);
+#else
+    return HAL_OK;
+#endif
+}
+
 HAL_StatusTypeDef QUADSPI_Read(uint32_t address, uint8_t *buffer, uint32_t size)
 {
 #if HARD_QPI
     QSPI_CommandTypeDef sCommand = {0};
-
-    sCommand.InstructionMode   = QSPI_INSTRUCTION_1_LINE;
-    sCommand.Instruction       = 0x03;                   // READ command
-    sCommand.AddressMode       = QSPI_ADDRESS_1_LINE;
-    sCommand.AddressSize       = QSPI_ADDRESS_24_BITS;
-    sCommand.Address           = address;
-    sCommand.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
-    sCommand.DataMode          = QSPI_DATA_1_LINE;
-    sCommand.DummyCycles       = 8;
-    sCommand.NbData            = size;
-    sCommand.DdrMode           = QSPI_DDR_MODE_DISABLE;
-    sCommand.DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
-    sCommand.SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
+    fill_read_command(&sCommand, address, size);
 
     // Send the read command
     if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QSPI_TIMEOUT_DEFAULT_VALUE) != HAL_OK)
@@ -210,25 +334,37 @@ HAL_StatusTypeDef QUADSPI_Read(uint32_t address, uint8_t *buffer, uint32_t size)
     return HAL_OK;
 }
 
-HAL_StatusTypeDef QUADSPI_Write(uint32_t address, uint8_t *buffer, uint32_t size)
+HAL_StatusTypeDef QUADSPI_Read_DMA(uint32_t address, uint8_t *buffer, uint32_t size, QUADSPI_ReadCallback cb)
 {
 #if HARD_QPI
     QSPI_CommandTypeDef sCommand = {0};
+    fill_read_command(&sCommand, address, size);
+
+    // Send the read command, data phase is served by DMA
+    HAL_StatusTypeDef status = HAL_QSPI_Command(&hqspi, &sCommand, HAL_QSPI_TIMEOUT_DEFAULT_VALUE);
+    if (status != HAL_OK)
+        return status;
+
+    dma_cb = cb;
+    status = HAL_QSPI_Receive_DMA(&hqspi, buffer);
+    if (status != HAL_OK)
+        dma_cb = NULL;
+    return status;
+#else
+    HAL_StatusTypeDef status = QUADSPI_Read(address, buffer, size);
+    if (status == HAL_OK && cb != NULL)
+        cb(true);
+    return status;
+#endif
+}
 
-    sCommand.InstructionMode   = QSPI_INSTRUCTION_1_LINE;
-    sCommand.Instruction       = 0x02;                   // WRITE command
-    sCommand.AddressMode       = QSPI_ADDRESS_1_LINE;
-    sCommand.AddressSize       = QSPI_ADDRESS_24_BITS;
-    sCommand.Address           = address;
-    sCommand.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
-    sCommand.DataMode          = QSPI_DATA_1_LINE;
-    sCommand.DummyCycles       = 0;
-    sCommand.NbData            = size;
-    sCommand.DdrMode           = QSPI_DDR_MODE_DISABLE;
-    sCommand.DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
-    sCommand.SIOOMode          = QSPI_SIOO_INST_EVERY_CMD;
+HAL_StatusTypeDef QUADSPI_Write(uint32_t address, uint8_t *buffer, uint32_t size)
+{
+#if HARD_QPI
+    QSPI_CommandTypeDef sCommand = {0};
+    fill_write_command(&sCommand, address, size);
 
-    // Send the read command
+    // Send the write command
     if (HAL_QSPI_Command(&hqspi, &sCommand, HAL_QSPI_TIMEOUT_DEFAULT_VALUE) != HAL_OK)
         return HAL_ERROR;
 
@@ -253,3 +389,113 @@ HAL_StatusTypeDef QUADSPI_Write(uint32_t address, uint8_t *buffer, uint32_t size
     return HAL_OK;
 
 }
+
+HAL_StatusTypeDef QUADSPI_Write_DMA(uint32_t address, uint8_t *buffer, uint32_t size, QUADSPI_WriteCallback cb)
+{
+#if HARD_QPI
+    QSPI_CommandTypeDef sCommand = {0};
+    fill_write_command(&sCommand, address, size);
+
+    // Send the write command, data phase is served by DMA
+    HAL_StatusTypeDef status = HAL_QSPI_Command(&hqspi, &sCommand, HAL_QSPI_TIMEOUT_DEFAULT_VALUE);
+    if (status != HAL_OK)
+        return status;
+
+    dma_cb = cb;
+    status = HAL_QSPI_Transmit_DMA(&hqspi, buffer);
+    if (status != HAL_OK)
+        dma_cb = NULL;
+    return status;
+#else
+    HAL_StatusTypeDef status = QUADSPI_Write(address, buffer, size);
+    if (status == HAL_OK && cb != NULL)
+        cb(true);
+    return status;
+#endif
+}
+
+static void task_done_cb(bool ok)
+{
+    BaseType_t woken = pdFALSE;
+    task_ok = ok;
+    xSemaphoreGiveFromISR(task_done, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/*
+ * Task transfer timed out: DMA is stopped before caller buffer goes away,
+ * a completion which came in the meantime does not wake the next transfer
+ */
+static void task_abort(void)
+{
+    taskENTER_CRITICAL();
+    if (dma_cb == task_done_cb) {
+        dma_cb = NULL;
+        HAL_QSPI_Abort(&hqspi);
+    }
+    taskEXIT_CRITICAL();
+    xSemaphoreTake(task_done, 0);
+}
+
+static HAL_StatusTypeDef task_wait(void)
+{
+    if (xSemaphoreTake(task_done, pdMS_TO_TICKS(QUADSPI_TASK_TIMEOUT_MS)) != pdTRUE) {
+        task_abort();
+        return HAL_TIMEOUT;
+    }
+    return task_ok ? HAL_OK : HAL_ERROR;
+}
+
+/*
+ * Stream reads are started from USB and QSPI interrupts. HAL unlocks the
+ * peripheral between command and data phase, so task transfers start
+ * with interrupts masked, data goes by DMA with interrupts enabled. A busy
+ * peripheral is tried again next tick.
+ */
+HAL_StatusTypeDef QUADSPI_TaskRead(uint32_t address, uint8_t *buffer, uint32_t size)
+{
+    unsigned try;
+    HAL_StatusTypeDef res;
+    xSemaphoreTake(task_lock, portMAX_DELAY);
+    task_pending = true;
+    for (try = 0; ; try++) {
+        taskENTER_CRITICAL();
+        res = QUADSPI_Read_DMA(address, buffer, size, task_done_cb);
+        taskEXIT_CRITICAL();
+        if (res == HAL_OK || try == QUADSPI_TASK_RETRIES)
+            break;
+        vTaskDelay(1);
+    }
+    if (res == HAL_OK)
+        res = task_wait();
+    task_pending = false;
+    xSemaphoreGive(task_lock);
+    return res;
+}
+
+HAL_StatusTypeDef QUADSPI_TaskWrite(uint32_t address, const uint8_t *buffer, uint32_t size)
+{
+    HAL_StatusTypeDef res = HAL_OK;
+    xSemaphoreTake(task_lock, portMAX_DELAY);
+    task_pending = true;
+    while (size > 0 && res == HAL_OK) {
+        uint32_t n = size > QUADSPI_TASK_WRITE_BLOCK ? QUADSPI_TASK_WRITE_BLOCK : size;
+        unsigned try;
+        for (try = 0; ; try++) {
+            taskENTER_CRITICAL();
+            res = QUADSPI_Write_DMA(address, (uint8_t *)buffer, n, task_done_cb);
+            taskEXIT_CRITICAL();
+            if (res == HAL_OK || try == QUADSPI_TASK_RETRIES)
+                break;
+            vTaskDelay(1);
+        }
+        if (res == HAL_OK)
+            res = task_wait();
+        address += n;
+        buffer += n;
+        size -= n;
+    }
+    task_pending = false;
+    xSemaphoreGive(task_lock);
+    return res;
+}
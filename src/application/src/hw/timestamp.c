@@ -0,0 +1,71 @@
+#ifndef STM32F446xx
+#define STM32F446xx
+#endif
+
+#include "system_config.h"
+#include "stm32f446xx.h"
+#include "stm32f4xx_hal.h"
+#include "hw/timestamp.h"
+
+TIM_HandleTypeDef htim2;
+
+static volatile uint32_t overflows;    // high word of 64-bit timestamp
+
+/*
+ * TIM2 is 32-bit and free running at TIMESTAMP_FREQ,
+ * used as device clock for UVC PTS/SCR. It wraps in about 71 minutes,
+ * update interrupt counts wraps for exposure times
+ */
+int TIMESTAMP_Init(void)
+{
+    __HAL_RCC_TIM2_CLK_ENABLE();
+
+    // APB1 timers are clocked at twice PCLK1 when APB1 is divided
+    uint32_t clk = HAL_RCC_GetPCLK1Freq() * 2U;
+
+    htim2.Instance = TIM2;
+    htim2.Init.Prescaler = clk / TIMESTAMP_FREQ - 1U;
+    htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
+    htim2.Init.Period = 0xFFFFFFFFU;
+    htim2.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    htim2.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+    if (HAL_TIM_Base_Init(&htim2) != HAL_OK)
+        return HAL_ERROR;
+
+    HAL_NVIC_SetPriority(TIM2_IRQn, TIMESTAMP_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(TIM2_IRQn);
+    return HAL_TIM_Base_Start_IT(&htim2);
+}
+
+void TIM2_IRQHandler(void)
+{
+    if (__HAL_TIM_GET_FLAG(&htim2, TIM_FLAG_UPDATE)) {
+        __HAL_TIM_CLEAR_FLAG(&htim2, TIM_FLAG_UPDATE);
+        overflows++;
+    }
+}
+
+uint32_t TIMESTAMP_Get(void)
+{
+    return __HAL_TIM_GET_COUNTER(&htim2);
+}
+
+/*
+ * Callers above TIMESTAMP_IRQ_PRIORITY or with interrupts masked see a
+ * wrap before it is counted, the pending flag stands for it then. Counter
+ * is read again after the flag, so it is the value after the wrap
+ */
+uint64_t TIMESTAMP_Get64(void)
+{
+    uint32_t counted, high, low;
+    do {
+        counted = overflows;
+        high = counted;
+        low = __HAL_TIM_GET_COUNTER(&htim2);
+        if (__HAL_TIM_GET_FLAG(&htim2, TIM_FLAG_UPDATE)) {
+            low = __HAL_TIM_GET_COUNTER(&htim2);
+            high++;
+        }
+    } while (counted != overflows);     // wrap was counted meanwhile
+    return (uint64_t)high << 32 | low;
+}
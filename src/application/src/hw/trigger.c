@@ -0,0 +1,121 @@
+#ifndef STM32F446xx
+#define STM32F446xx
+#endif
+
+#include "system_config.h"
+#include "stm32f446xx.h"
+#include "stm32f4xx_hal.h"
+#include "hw/trigger.h"
+#include "hw/timestamp.h"
+
+/*
+ * External trigger on COMMAND_TRG (PD5, EXTI5).
+ *
+ * Exposure timer is loaded when trigger is armed, so interrupt only
+ * writes two TIM5 registers and SHUTTER follows the trigger edge by
+ * interrupt entry and a few instructions. Interrupt is above FreeRTOS
+ * priorities, so it is never delayed by critical sections, and end of
+ * exposure is reported by TIM5 interrupt as usual.
+ *
+ * Latency is counted by DWT from interrupt entry to SHUTTER register
+ * write, plus fixed exception entry time, which DWT can not see.
+ */
+
+#define TRIGGER_ENTRY_CYCLES 12U    // Cortex-M4 exception entry, zero wait state
+
+static volatile bool armed;
+static volatile bool bulb_open;     // bulb exposure waits for falling edge
+static bool bulb;
+static volatile uint64_t trigger_time;
+static volatile struct TRIGGER_Latency latency_cycles;
+
+int TRIGGER_Init(void)
+{
+    __HAL_RCC_GPIOD_CLK_ENABLE();
+
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    GPIO_InitStruct.Pin = COMMAND_TRG_Pin;
+    GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    HAL_GPIO_Init(COMMAND_TRG_GPIO_Port, &GPIO_InitStruct);
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    HAL_NVIC_SetPriority(EXTI9_5_IRQn, TRIGGER_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
+    return HAL_OK;
+}
+
+uint64_t TRIGGER_Arm(uint64_t duration, bool use_bulb, EXPOSURE_Callback cb)
+{
+    uint64_t exposure = EXPOSURE_Arm(duration, cb);
+    if (exposure == 0)
+        return 0;
+    bulb = use_bulb;
+    bulb_open = false;
+    armed = true;
+    return exposure;
+}
+
+bool TRIGGER_Disarm(void)
+{
+    __disable_irq();
+    bool was_armed = armed;
+    armed = false;
+    bulb_open = false;
+    __enable_irq();
+    if (was_armed)
+        EXPOSURE_Abort();
+    return was_armed;
+}
+
+uint64_t TRIGGER_GetTime(void)
+{
+    __disable_irq();
+    uint64_t time = trigger_time;
+    __enable_irq();
+    return time;
+}
+
+void TRIGGER_GetLatency(struct TRIGGER_Latency *latency)
+{
+    __disable_irq();
+    struct TRIGGER_Latency cycles = latency_cycles;
+    __enable_irq();
+
+    uint32_t mhz = SystemCoreClock / 1000000U;
+    latency->last = cycles.last * 1000U / mhz;
+    latency->min = cycles.min * 1000U / mhz;
+    latency->max = cycles.max * 1000U / mhz;
+    latency->count = cycles.count;
+}
+
+void EXTI9_5_IRQHandler(void)
+{
+    uint32_t entry = DWT->CYCCNT;
+    if (!__HAL_GPIO_EXTI_GET_IT(COMMAND_TRG_Pin))
+        return;
+    __HAL_GPIO_EXTI_CLEAR_IT(COMMAND_TRG_Pin);
+
+    bool level = (COMMAND_TRG_GPIO_Port->IDR & COMMAND_TRG_Pin) != 0;
+    if (level && armed) {
+        EXPOSURE_Fire();
+        uint32_t cycles = DWT->CYCCNT - entry + TRIGGER_ENTRY_CYCLES;
+
+        armed = false;
+        bulb_open = bulb;
+        trigger_time = TIMESTAMP_Get64();
+
+        latency_cycles.last = cycles;
+        if (latency_cycles.count == 0 || cycles < latency_cycles.min)
+            latency_cycles.min = cycles;
+        if (cycles > latency_cycles.max)
+            latency_cycles.max = cycles;
+        latency_cycles.count++;
+    } else if (!level && bulb_open && EXPOSURE_Busy()) {
+        EXPOSURE_Stop();
+        bulb_open = false;
+    }
+}
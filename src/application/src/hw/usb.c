@@ -56,7 +56,7 @@ void HAL_PCD_MspInit(PCD_HandleTypeDef *pcdHandle)
         __HAL_RCC_USB_OTG_HS_ULPI_CLK_ENABLE();
 
         /* Peripheral interrupt init */
-        HAL_NVIC_SetPriority(OTG_HS_IRQn, 0, 0);
+        HAL_NVIC_SetPriority(OTG_HS_IRQn, STREAM_IRQ_PRIORITY, 0);
         HAL_NVIC_EnableIRQ(OTG_HS_IRQn);
     }
 }
@@ -23,11 +23,15 @@
 #include "hw/spi.h"
 #include "hw/quadspi.h"
 #include "hw/fpga-ctl.h"
+#include "hw/timestamp.h"
+#include "hw/exposure.h"
+#include "hw/trigger.h"
 #include "usb_device.h"
 
 #include "core.h"
 #include "shell.h"
 #include "config.h"
+#include "defect_map.h"
 
 #include <FreeRTOS.h>
 #include <task.h>
@@ -40,6 +44,11 @@ static StackType_t  sensors_poll_task_stack[SENSORS_POLL_TASK_STACK_SIZE];
 static TaskHandle_t sensors_poll_task;
 static StaticTask_t sensors_poll_task_buffer;
 
+#define EXPOSURE_TASK_STACK_SIZE 200
+static StackType_t  exposure_task_stack[EXPOSURE_TASK_STACK_SIZE];
+static TaskHandle_t exposure_task;
+static StaticTask_t exposure_task_buffer;
+
 #define SHELL_TASK_STACK_SIZE 300
 static StackType_t  shell_task_stack[SHELL_TASK_STACK_SIZE];
 static TaskHandle_t shell_task;
@@ -104,7 +113,6 @@ int main(void)
     SYSCLK_Config();
     I2C1_Init();
     QUADSPI_Init();
-    //QSPI_EnableMemoryMapped();
     FPGA_CTL_Init();
 
     bool boot_dfu = is_dfu();
@@ -123,9 +131,19 @@ int main(void)
         USART1_Init(115200);
         UART5_Init(9600);
         SPI4_Init();
+        TIMESTAMP_Init();
+        EXPOSURE_Init();
+        TRIGGER_Init();
 
         load_config(&camera_config);
-        struct usb_context_s *usb_ctx = USB_DEVICE_Init(2, camera_config.width, camera_config.height, camera_config.FourCC);
+        defect_map_load(camera_config.width, camera_config.height);
+        const char *formats[] = {
+            camera_config.FourCC,
+            camera_config.FourCC_Y12P,
+            camera_config.FourCC_Y10P,
+            camera_config.FourCC_Rice,
+        };
+        struct usb_context_s *usb_ctx = USB_DEVICE_Init(2, camera_config.width, camera_config.height, formats);
         if (usb_ctx == NULL)
             goto error;
 
@@ -141,6 +159,15 @@ int main(void)
                                               sensors_poll_task_stack,
                                               &sensors_poll_task_buffer);
 
+        // exposure timing goes before sensors and shell
+        exposure_task = xTaskCreateStatic(core_exposure_function,
+                                          "exposure",
+                                          EXPOSURE_TASK_STACK_SIZE,
+                                          NULL,
+                                          2,
+                                          exposure_task_stack,
+                                          &exposure_task_buffer);
+
         shell_task = xTaskCreateStatic(shell_task_function,
                                        "shell",
                                        SHELL_TASK_STACK_SIZE,
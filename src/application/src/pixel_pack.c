@@ -0,0 +1,68 @@
+#ifndef STM32F446xx
+#define STM32F446xx
+#endif
+
+#include <string.h>
+
+#include "stm32f446xx.h"
+#include "pixel_pack.h"
+
+/*
+ * Two pixels are handled per 32-bit word with DSP instructions:
+ * UXTB16 on the word rotated by 8 extracts high bytes of both pixels,
+ * low bits of both are masked at once, PKHBT joins halfwords of two words.
+ * All loads of a group are done before its stores, so in place packing
+ * never overwrites pixels which are not read yet.
+ */
+
+static inline uint32_t load_pair(const uint16_t *src)
+{
+    uint32_t w;
+    memcpy(&w, src, sizeof(w));
+    return w;
+}
+
+/* high bytes of the pair in the low halfword: p0[15:8] | p1[15:8] << 8 */
+static inline uint32_t high_bytes(uint32_t w)
+{
+    uint32_t h = __UXTB16(__ROR(w, 8));
+    return h | (h >> 8);
+}
+
+size_t pack_y12p(uint8_t *dst, const uint16_t *src, size_t npixels)
+{
+    uint8_t *out = dst;
+    size_t i;
+    for (i = 0; i < npixels; i += 2) {
+        uint32_t w = load_pair(src + i);
+        uint32_t h = high_bytes(w);
+        uint32_t l = (w >> 4) & 0x000F000FU;
+
+        out[0] = h;
+        out[1] = h >> 8;
+        out[2] = l | (l >> 12);
+        out += 3;
+    }
+    return out - dst;
+}
+
+size_t pack_y10p(uint8_t *dst, const uint16_t *src, size_t npixels)
+{
+    uint8_t *out = dst;
+    size_t i;
+    for (i = 0; i < npixels; i += 4) {
+        uint32_t w0 = load_pair(src + i);
+        uint32_t w1 = load_pair(src + i + 2);
+
+        uint32_t h = __PKHBT(high_bytes(w0), high_bytes(w1), 16);
+        uint32_t l0 = (w0 >> 6) & 0x00030003U;
+        uint32_t l1 = (w1 >> 6) & 0x00030003U;
+        l0 |= l0 >> 14;
+        l1 |= l1 >> 14;
+
+        memcpy(out, &h, sizeof(h));
+        out[4] = (l0 & 0x0FU) | (l1 << 4);
+        out += 5;
+    }
+    return out - dst;
+}
@@ -8,10 +8,155 @@
 
 #include "hw/quadspi.h"
 #include "usb_device.h"
+#include "pixel_pack.h"
+#include "frame_encoder.h"
+#include "frame_queue.h"
+#include "core.h"
+#include "config.h"
+#include "defect_map.h"
+#include "system_config.h"
 #include "shell.h"
 
 #define CMDLINE_LEN 32
 
+#define PACK_TEST_PIXELS 256U
+
+/* Must match utils/packref.py */
+static uint32_t pack_test_crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFFU;
+    size_t i;
+    int bit;
+    for (i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320U & -(crc & 1U));
+    }
+    return ~crc;
+}
+
+/*
+ * Synthetic deep sky row: smooth background with noise and some stars
+ */
+static void bench_synthetic_row(uint16_t *row, unsigned width, unsigned y, uint32_t *seed)
+{
+    unsigned x;
+    for (x = 0; x < width; x++) {
+        *seed = *seed * 1664525U + 1013904223U;
+        uint32_t r = *seed >> 8;
+        // sum of 4 uniform values is close to gaussian, sigma about 16
+        uint32_t noise = (r & 0x3FU) + ((r >> 6) & 0x3FU) + ((r >> 12) & 0x3FU) + ((r >> 18) & 0x3FU);
+        uint32_t value = 1000U + (x + y) / 8U + noise;
+        if ((x * 7919U + y * 104729U) % 4099U == 0)
+            value += 20000U;
+        row[x] = value;
+    }
+}
+
+/*
+ * Compress frame in SRAM (or synthetic one), report ratio and encoder
+ * cycles per pixel, measured by DWT cycle counter
+ */
+static void compress_bench(bool synthetic)
+{
+    static uint16_t row[FRAME_MAX_WIDTH];
+    static uint8_t coded[FRAME_ENCODER_ROW_MAX(FRAME_MAX_WIDTH)];
+    unsigned width = camera_config.width;
+    unsigned height = camera_config.height;
+    if (width == 0 || width > FRAME_MAX_WIDTH) {
+        printf("Width %u not supported\r\n", width);
+        return;
+    }
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    uint64_t cycles = 0;
+    uint32_t coded_bytes = 0;
+    uint32_t seed = 1;
+    uint16_t prev_first = 0;
+    unsigned y;
+    for (y = 0; y < height; y++) {
+        if (synthetic)
+            bench_synthetic_row(row, width, y, &seed);
+        else if (QUADSPI_TaskRead(y * width * 2U, (uint8_t *)row, width * 2U) != HAL_OK) {
+            printf("Read error at row %u\r\n", y);
+            return;
+        }
+
+        uint32_t start = DWT->CYCCNT;
+        coded_bytes += frame_encoder_encode_row(coded, row, width, &prev_first);
+        cycles += DWT->CYCCNT - start;
+    }
+
+    uint32_t pixels = width * height;
+    uint32_t ratio = (uint64_t)pixels * 2U * 100U / coded_bytes;
+    uint32_t cpp = cycles * 100U / pixels;
+    printf("%u x %u, %lu -> %lu bytes, ratio %lu.%02lu\r\n", width, height,
+           (unsigned long)(pixels * 2U), (unsigned long)coded_bytes,
+           (unsigned long)(ratio / 100U), (unsigned long)(ratio % 100U));
+    printf("%lu.%02lu cycles per pixel\r\n", (unsigned long)(cpp / 100U), (unsigned long)(cpp % 100U));
+}
+
+static void pack_test(void)
+{
+    static uint16_t pixels[PACK_TEST_PIXELS];
+    static uint8_t packed[PACK_TEST_PIXELS * 2];
+    uint32_t x = 1;
+    unsigned i;
+    for (i = 0; i < PACK_TEST_PIXELS; i++) {
+        x = x * 1664525U + 1013904223U;
+        pixels[i] = x >> 16;
+    }
+
+    size_t len = pack_y12p(packed, pixels, PACK_TEST_PIXELS);
+    printf("Y12P %u bytes crc32 %08lX\r\n", (unsigned)len, (unsigned long)pack_test_crc32(packed, len));
+    len = pack_y10p(packed, pixels, PACK_TEST_PIXELS);
+    printf("Y10P %u bytes crc32 %08lX\r\n", (unsigned)len, (unsigned long)pack_test_crc32(packed, len));
+}
+
+static void print_stage(const char *name, const struct core_stage_timing_s *stage)
+{
+    uint32_t avg = stage->count != 0 ? (uint32_t)(stage->sum / stage->count) : 0;
+    printf("%-8s last %10lu min %10lu avg %10lu max %10lu us\r\n", name,
+           (unsigned long)stage->last, (unsigned long)stage->min,
+           (unsigned long)avg, (unsigned long)stage->max);
+}
+
+static void core_timing(void)
+{
+    struct core_timing_s timing;
+    core_get_timing(&timing);
+    printf("Frames %lu, delayed for slot %lu\r\n",
+           (unsigned long)timing.frames, (unsigned long)timing.slot_waits);
+    print_stage("exposure", &timing.exposure);
+    print_stage("readout", &timing.readout);
+    print_stage("upload", &timing.upload);
+    print_stage("dead", &timing.dead);
+}
+
+/*
+ * OTG interrupt load over one second, run while streaming with
+ * USBD_HS_DMA_ENABLE on and off to compare FIFO copy with DMA
+ */
+static void usb_load(void)
+{
+    uint32_t cycles0, count0, cycles1, count1;
+    USB_DEVICE_GetIrqLoad(&cycles0, &count0);
+    uint32_t start = DWT->CYCCNT;
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    USB_DEVICE_GetIrqLoad(&cycles1, &count1);
+    uint32_t total = DWT->CYCCNT - start;
+
+    uint32_t cycles = cycles1 - cycles0;
+    uint32_t count = count1 - count0;
+    uint32_t load = (uint32_t)((uint64_t)cycles * 10000U / total);
+    printf("USB DMA %s: %lu interrupts, %lu cycles avg, load %lu.%02lu %%\r\n",
+           USBD_HS_DMA_ENABLE ? "on" : "off", (unsigned long)count,
+           (unsigned long)(count != 0 ? cycles / count : 0),
+           (unsigned long)(load / 100U), (unsigned long)(load % 100U));
+}
+
 void ctl_spi_begin();
 void ctl_spi_finish(void);
 uint8_t ctl_spi_transfer(uint8_t data);
@@ -24,6 +169,15 @@ void process_command(const char *cmd)
         printf("Commands:\r\n");
         printf("  readctl\r\n");
         printf("  writectl\r\n");
+        printf("  pt - packed formats self test, compare with utils/packref.py\r\n");
+        printf("  cb [s] - compression benchmark on SRAM frame, or synthetic one\r\n");
+        printf("  fq - frame queue slots\r\n");
+        printf("  ct - exposure pipeline timing\r\n");
+        printf("  ul - USB interrupt load\r\n");
+        printf("  dl - list hot pixels\r\n");
+        printf("  da <X> <Y> - add hot pixel\r\n");
+        printf("  dr <X> <Y> - remove hot pixel\r\n");
+        printf("  dc - clear hot pixels\r\n");
     } else if (!strncmp(cmd, "rc ", 3U)) {
         int addr;
         int num;
@@ -91,7 +245,11 @@ void process_command(const char *cmd)
                 num = sizeof(buf);
 
             printf("Read mem at 0x%06X %d bytes\r\n", addr, num);
-            QUADSPI_Read(addr, buf, num);
+            // stream reads may run, task read waits for them
+            if (QUADSPI_TaskRead(addr, buf, num) != HAL_OK) {
+                printf("Read error\r\n");
+                return;
+            }
             uint8_t cnt;
             for (cnt = 0; cnt < num; cnt++)
                 printf("0x%06X : 0x%02X\r\n", addr + cnt, buf[cnt]);
@@ -110,9 +268,43 @@ void process_command(const char *cmd)
             printf("Allowed mem addr = 0x00000000....0x00FFFFFF\r\n");
         } else {
             printf("Write mem at 0x%06X = %02X\r\n", addr, val);
-            QUADSPI_Write(addr, &val, 1);
+            if (QUADSPI_TaskWrite(addr, &val, 1) != HAL_OK)
+                printf("Write error\r\n");
             printf("\r\n");
         }
+    } else if (!strncmp(cmd, "pt", 2U)) {
+        pack_test();
+    } else if (!strncmp(cmd, "cb", 2U)) {
+        compress_bench(cmd[2] == ' ' && cmd[3] == 's');
+    } else if (!strncmp(cmd, "fq", 2U)) {
+        struct frame_queue_stats_s stats;
+        frame_queue_get_stats(&stats);
+        printf("Frame slots %u, queued %u, dropped %lu\r\n",
+               stats.slots, stats.queued, (unsigned long)stats.dropped);
+    } else if (!strncmp(cmd, "ct", 2U)) {
+        core_timing();
+    } else if (!strncmp(cmd, "ul", 2U)) {
+        usb_load();
+    } else if (!strncmp(cmd, "dl", 2U)) {
+        unsigned i, count = defect_map_count();
+        printf("Hot pixels %u of %u\r\n", count, (unsigned)DEFECT_MAP_MAX);
+        for (i = 0; i < count; i++) {
+            uint16_t x, y;
+            if (defect_map_get(i, &x, &y) == 0)
+                printf("%u %u\r\n", x, y);
+        }
+    } else if (!strncmp(cmd, "da ", 3U) || !strncmp(cmd, "dr ", 3U)) {
+        unsigned x, y;
+        if (sscanf(cmd + 3, "%u %u", &x, &y) != 2 || x > 0xFFFFU || y > 0xFFFFU) {
+            printf("Usage: %c%c <X> <Y>\r\n", cmd[0], cmd[1]);
+            return;
+        }
+        int res = cmd[1] == 'a' ? defect_map_add(x, y) : defect_map_remove(x, y);
+        if (res != 0)
+            printf("Failed\r\n");
+    } else if (!strncmp(cmd, "dc", 2U)) {
+        if (defect_map_clear() != 0)
+            printf("Failed\r\n");
     } else {
         printf("Unknown command \"%s\"\r\n", cmd);
     }   
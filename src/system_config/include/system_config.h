@@ -39,6 +39,9 @@ extern "C"
 #define COMMAND_TRG_Pin GPIO_PIN_5
 #define COMMAND_TRG_GPIO_Port GPIOD
 
+#define SHUTTER_Pin GPIO_PIN_0                   // TIM5_CH1, active for the exposure time
+#define SHUTTER_GPIO_Port GPIOA
+
 /* USB */
 #define DEVICE_USB_VID 1155
 #define DEVICE_USB_PID 22315
@@ -48,9 +51,28 @@ extern "C"
 #define I2C_EEPROM_BASE_ADDR 0xA0U
 #define I2C_EEPROM_SIZE 1024U
 
+/*
+ * Interrupt priorities. Streaming interrupts (OTG_HS, QUADSPI and its DMA)
+ * share one priority, so they never preempt each other. It is the highest
+ * one allowed to call FreeRTOS, see configMAX_SYSCALL_INTERRUPT_PRIORITY
+ */
+#define STREAM_IRQ_PRIORITY 0x0AU
+#define TRIGGER_IRQ_PRIORITY 0x00U               // above FreeRTOS, must not call it
+
+/* Timestamps, TIM2 free-running counter, overflows extend it to 64 bits */
+#define TIMESTAMP_FREQ 1000000U
+#define TIMESTAMP_IRQ_PRIORITY 0x0FU             // readers count a pending overflow themselves
+
+/* Exposure, TIM5 one pulse. Longer exposures than 2^32 ticks use coarser tick */
+#define EXPOSURE_FREQ 1000000U
+#define EXPOSURE_IRQ_PRIORITY 0x0AU
+
 /* Framebuffer */
 #define SRAM_SIZE (4*0x400000U)
 #define FPGA_FLASH_SIZE (0x80000U)
+#define FRAME_MAX_WIDTH 2048U                    // widest frame which can be binned
+#define FRAME_QUEUE_MAX_SLOTS 32U                // frames queued in SRAM at most
+#define FRAME_QUEUE_SLOT_ALIGN 0x1000U           // slot addresses are aligned to
 
 #ifdef __cplusplus
 }
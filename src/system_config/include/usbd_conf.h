@@ -15,9 +15,9 @@ extern "C"
 // Common USB options
 #define USE_USB_HS 1U
 
-#define CAMERA_DESC_BUFLEN 300U
+#define CAMERA_DESC_BUFLEN 1024U
 
-#define USBD_MAX_NUM_INTERFACES 5U
+#define USBD_MAX_NUM_INTERFACES (6U + CAMERA_RAW_ENABLE)
 #define USBD_MAX_NUM_CONFIGURATION 1U
 #define USBD_MAX_STR_DESC_SIZ 512U
 #define USBD_DEBUG_LEVEL 0U
@@ -27,7 +27,7 @@ extern "C"
 
 #define USBD_SUPPORT_USER_STRING_DESC                   1U
 
-#define CAMERA_TOTAL_INTERFACES                         0x06U
+#define CAMERA_TOTAL_INTERFACES                         (0x06U + CAMERA_RAW_ENABLE)
 
 /*
  * Endpoints list:
@@ -36,8 +36,22 @@ extern "C"
  *     0x82 - CDC ACM EPIN    - tx fifo 2
  *     0x01 - CDC DATA EPOUT
  *     0x83 - CDC DATA EPIN   - tx fifo 3
+ *     0x84 - GUIDE EPIN      - tx fifo 4
+ *     0x85 - RAW EPIN        - tx fifo 5, with OTG DMA only
  */
 
+/*
+ * OTG HS internal DMA: the core moves packets between memory and FIFOs,
+ * interrupt does no FIFO copy. Buffers given to the core must be word
+ * aligned, OUT buffers are written by whole words. EP0 IN replies are
+ * copied into an aligned buffer, they often come from stack. The core
+ * keeps DMA addresses of endpoints in the end of FIFO RAM.
+ */
+#define USBD_HS_DMA_ENABLE                              1U
+#define USBD_DMA_ALIGN(len)                             (((len) + 3U) & ~3U)
+#define USBD_EP0_TX_BUF_SIZE                            1024U   // longest copied EP0 IN reply
+#define USBD_DMA_FIFO_RESERVE                           (4U * 6U)   // words, 4 per endpoint number in use
+
 // Camera options
 #define USBD_UVC_FORMAT_UNCOMPRESSED
 
@@ -48,10 +62,28 @@ extern "C"
 #define CAMERA_UVC_TFR_CHARACTERISTICS                  0x01U
 #define CAMERA_UVC_COLOR_PRIMARIE                       0x01U
 
+#define CAMERA_UVC_BULK                                 0U      // 1 - stream over bulk endpoint in VS alt 0, for long exposures
+
 #define CAMERA_UVC_EPIN                                 0x81U
+#if CAMERA_UVC_BULK
+#define CAMERA_UVC_EPIN_SIZE                            512U
+#define CAMERA_UVC_EPIN_MULT                            1U
+#define CAMERA_UVC_NUM_ALTS                             0U
+#define CAMERA_UVC_PAYLOAD_SIZE                         (16U * CAMERA_UVC_EPIN_SIZE)
+#else
 #define CAMERA_UVC_EPIN_SIZE                            1024U
-#define CAMERA_UVC_TXFIFO                               ((unsigned)(CAMERA_UVC_EPIN_SIZE/4+1))
-#define UVC_CHUNK                                       512U
+#define CAMERA_UVC_EPIN_MULT                            2U      // high-bandwidth: transactions per microframe, 1..3, third one does not fit FIFO RAM with RAW endpoint
+#define CAMERA_UVC_NUM_ALTS                             5U      // VS alternate settings, from 128 bytes up to EPIN_SIZE * EPIN_MULT
+#define CAMERA_UVC_PAYLOAD_SIZE                         (CAMERA_UVC_EPIN_SIZE * CAMERA_UVC_EPIN_MULT)
+#endif
+#define UVC_HEADER_LEN                                  12U
+#define CAMERA_STATS_BINS                               256U    // histogram of the last streamed frame, high byte of Y16 pixel
+#define CAMERA_UVC_METADATA_LEN                         36U     // frame metadata, extends header of the first payload of each frame
+#define UVC_CHUNK                                       (CAMERA_UVC_PAYLOAD_SIZE - UVC_HEADER_LEN)
+#define UVC_NUM_BUFFERS                                 2U      // chunk buffers filled from SRAM while another one is sent
+#define CAMERA_UVC_ZERO_COPY                            (CAMERA_UVC_BULK && USBD_HS_DMA_ENABLE)    // bulk payload past its first packet goes by OTG DMA from memory-mapped SRAM
+#define CAMERA_UVC_NUM_FRAMES                           3U      // frame descriptors: full frame, 2x2 and 4x4 binning
+#define CAMERA_UVC_CLOCK_FREQUENCY                      TIMESTAMP_FREQ  // dwClockFrequency, PTS and SCR units
 
 // DFU options
 #define CAMERA_DFU_RUNTIME_INTERFACE_ID                 0x02U
@@ -75,15 +107,73 @@ extern "C"
 
 #define CAMERA_CDC_DATA_TXFIFO                          ((unsigned)(CAMERA_CDC_DATA_EPIN_SIZE/4+1))
 
+// Guide options: vendor interface, star centroids of guide ROIs on interrupt endpoint
+#define CAMERA_GUIDE_INTERFACE_ID                       0x05U
+#define CAMERA_GUIDE_EPIN                               0x84U
+#define CAMERA_GUIDE_EPIN_SIZE                          64U
+#define CAMERA_GUIDE_TXFIFO                             ((unsigned)(CAMERA_GUIDE_EPIN_SIZE/4+1))
+#define CAMERA_GUIDE_MAX_ROIS                           4U
+#define CAMERA_GUIDE_MAX_ROI_SIZE                       32U     // pixels, ROI is square
+
+// Raw options: vendor interface, full frames as stored in SRAM on bulk endpoint
+#define CAMERA_RAW_ENABLE                               USBD_HS_DMA_ENABLE      // frames go by OTG DMA from memory-mapped SRAM
+#define CAMERA_RAW_INTERFACE_ID                         0x06U
+#define CAMERA_RAW_EPIN                                 0x85U
+#define CAMERA_RAW_EPIN_SIZE                            512U
+#define CAMERA_RAW_TXFIFO                               (CAMERA_RAW_ENABLE ? 2U * USBD_FIFO_WORDS(CAMERA_RAW_EPIN_SIZE) : 0U)
+#define CAMERA_RAW_HEADER_LEN                           CAMERA_RAW_EPIN_SIZE    // frame header, one full packet
+#define CAMERA_RAW_BLOCK                                (32U * CAMERA_RAW_EPIN_SIZE)   // frame data sent per transmit, SRAM is mapped that long
+
+/*
+ * FIFO RAM plan, 32-bit words. OTG HS has 4 KB of FIFO RAM shared by
+ * RxFIFO, TxFIFOs of IN endpoints and, with DMA, endpoint DMA addresses.
+ * RxFIFO follows the reference manual: 5 words per control endpoint + 8
+ * for setup packets, two largest OUT packets with status words, 2 words
+ * per OUT endpoint, 1 for global NAK. EP0 TxFIFO holds two packets,
+ * interrupt and CDC endpoints one, RAW endpoint two. UVC endpoint gets
+ * the rest.
+ */
+#define USBD_FIFO_RAM_WORDS                             1024U
+#define USBD_FIFO_WORDS(bytes)                          (((bytes) + 3U) / 4U)
+#define USBD_EP0_MAX_PACKET                             64U     // USB_MAX_EP0_SIZE
+#define USBD_NUM_OUT_EPS                                2U      // EP0, CDC DATA
+#define USBD_MAX_OUT_PACKET                             (CAMERA_CDC_DATA_EPOUT_SIZE > USBD_EP0_MAX_PACKET ? \
+                                                         CAMERA_CDC_DATA_EPOUT_SIZE : USBD_EP0_MAX_PACKET)
+#define USBD_RXFIFO                                     (5U * 1U + 8U + \
+                                                         2U * (USBD_FIFO_WORDS(USBD_MAX_OUT_PACKET) + 1U) + \
+                                                         2U * USBD_NUM_OUT_EPS + 1U)
+#define USBD_EP0_TXFIFO                                 (2U * USBD_FIFO_WORDS(USBD_EP0_MAX_PACKET))
+#define USBD_FIFO_DMA_WORDS                             (USBD_HS_DMA_ENABLE ? USBD_DMA_FIFO_RESERVE : 0U)
+#define USBD_FIFO_FIXED_WORDS                           (USBD_RXFIFO + USBD_EP0_TXFIFO + \
+                                                         CAMERA_CDC_ACM_TXFIFO + CAMERA_CDC_DATA_TXFIFO + \
+                                                         CAMERA_GUIDE_TXFIFO + CAMERA_RAW_TXFIFO + \
+                                                         USBD_FIFO_DMA_WORDS)
+#define CAMERA_UVC_TXFIFO                               ((unsigned)(USBD_FIFO_RAM_WORDS - USBD_FIFO_FIXED_WORDS))
+
 // Camera options
 
 #define VC_DEFAULT_EXPOSURE 1000U
 
+// CT_AE_MODE_CONTROL values
+#define VC_AE_MODE_MANUAL               0x01U
+#define VC_AE_MODE_AUTO                 0x02U   // exposure and gain
+#define VC_AE_MODE_APERTURE_PRIORITY    0x08U   // exposure only, gain is manual
+#define VC_DEFAULT_AE_TARGET            0x4000U // ADU
+#define VC_DEFAULT_AE_PERCENTILE        50U     // median
+
+/* Frame stacking */
+#define VC_STACK_REJECT_MINMAX          0x01U   // drop min and max of each pixel
+#define VC_STACK_MAX_SHIFT              16U
+
 #define UVC_CAM_FPS_HS 2U
 #define UVC_CAM_FPS_FS 1U
 #define UVC_WIDTH 640U
 #define UVC_HEIGHT 480U
 #define UVC_BITS_PER_PIXEL 16U
+#define CAMERA_UVC_NUM_FORMATS 4U   // Y16, packed 12 bit, packed 10 bit, Rice compressed Y16
+
+// Rice compressed format: pixels per block sharing one Rice parameter
+#define CAMERA_UVC_RICE_BLOCK 32U
 
 
 /****************************************/
@@ -137,6 +227,8 @@ extern "C"
 /* Exported functions -------------------------------------------------------*/
 void *USBD_static_malloc(uint32_t size);
 void USBD_static_free(void *p);
+struct _USBD_HandleTypeDef;
+uint16_t USBD_LL_GetFrameNumber(struct _USBD_HandleTypeDef *pdev);
 
 #ifdef __cplusplus
 }
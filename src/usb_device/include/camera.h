@@ -20,6 +20,22 @@ enum HID_OutputReportId_e {
 struct USBD_CAMERA_callbacks_t {
     uint8_t (*VS_StartStream)(void);
     uint8_t (*VS_StopStream)(void);
+    uint8_t (*VS_ReadFrame)(uint32_t offset, uint8_t *buf, size_t len);
+    uint8_t (*VS_MapFrame)(uint32_t offset, size_t len, const uint8_t **data);
+    uint8_t (*VS_SetMapped)(bool mapped);
+
+    uint8_t (*RAW_StartStream)(void);
+    uint8_t (*RAW_StopStream)(void);
+    uint8_t (*RAW_NextFrame)(uint8_t *header, const uint8_t **data, uint32_t *size);
+    uint8_t (*RAW_ResendFrame)(uint8_t *header, uint32_t sequence, uint32_t offset, uint32_t length,
+                               const uint8_t **data, uint32_t *size);
+    uint8_t (*RAW_FrameDone)(void);
+    uint8_t (*VS_GetTimestamp)(uint32_t *timestamp);
+    uint8_t (*VS_SetBinning)(unsigned binning);
+    uint8_t (*VS_SetPacking)(unsigned bits);
+    uint8_t (*VS_SetCompression)(bool compressed);
+    uint8_t (*VS_StillTrigger)(void);
+    uint8_t (*VS_StillDone)(void);
 
     uint8_t (*VC_SetGain)(unsigned gain);
     uint8_t (*VC_GetGain)(unsigned *gain);
@@ -40,15 +56,34 @@ struct USBD_CAMERA_callbacks_t {
 
     uint8_t (*VC_SetExposure)(uint32_t exposure);
     uint8_t (*VC_GetExposure)(uint32_t *exposure);
+    uint8_t (*VC_SetExposureUs)(uint32_t exposure);
+    uint8_t (*VC_GetExposureUs)(uint32_t *exposure);
+    uint8_t (*VC_GetTriggerLatency)(uint32_t latency[4]);
+    uint8_t (*VC_GetFrameStats)(uint32_t stats[6]);
+    uint8_t (*VC_GetFrameHistogram)(uint32_t histogram[CAMERA_STATS_BINS]);
+    uint8_t (*VC_SetAEMode)(unsigned mode);
+    uint8_t (*VC_GetAEMode)(unsigned *mode);
+    uint8_t (*VC_SetAETarget)(unsigned target, unsigned percentile);
+    uint8_t (*VC_GetAETarget)(unsigned *target, unsigned *percentile);
+    uint8_t (*VC_SetGuideROIs)(unsigned count, unsigned size, uint16_t centers[][2]);
+    uint8_t (*VC_GetGuideROIs)(unsigned *count, unsigned *size, uint16_t centers[][2]);
+    uint8_t (*VC_SetStack)(unsigned depth, unsigned flags, unsigned shift);
+    uint8_t (*VC_GetStack)(unsigned *depth, unsigned *flags, unsigned *shift);
     uint8_t (*CDC_ACM_Control)(uint8_t request, uint8_t *data, size_t len);
     uint8_t (*CDC_DATA_DataOut)(const uint8_t *data, size_t len);
 };
 
 
-uint8_t USBD_CAMERA_Configure(unsigned fps, unsigned width, unsigned height, const char *FourCC);
+uint8_t USBD_CAMERA_Configure(unsigned fps, unsigned width, unsigned height, const char *const FourCC[]);
 uint8_t USBD_CAMERA_Configure_DFU(void);
 
 uint8_t USBD_CAMERA_CDC_DATA_SendSerial(USBD_HandleTypeDef *pdev, const uint8_t *data, size_t len);
+uint8_t USBD_CAMERA_GUIDE_SendReport(USBD_HandleTypeDef *pdev, const uint8_t *data, size_t len);
+uint8_t USBD_CAMERA_VS_ChunkFilled(USBD_HandleTypeDef *pdev, bool ok);
+uint8_t USBD_CAMERA_VS_ChunkFilledSize(USBD_HandleTypeDef *pdev, size_t len, bool eof);
+uint8_t USBD_CAMERA_VS_SetPTS(USBD_HandleTypeDef *pdev, uint32_t pts);
+uint8_t USBD_CAMERA_VS_SetMetadata(USBD_HandleTypeDef *pdev, const uint8_t *metadata);
+uint8_t USBD_CAMERA_VS_StillReady(USBD_HandleTypeDef *pdev);
 
 uint8_t USBD_CAMERA_RegisterInterface(USBD_HandleTypeDef *pdev, struct USBD_CAMERA_callbacks_t* cbs);
 
@@ -2,12 +2,13 @@
 
 #include <unistd.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 ssize_t camera_generate_descriptor(uint8_t *pConf,
                                    uint8_t fps,
                                    uint16_t width,
                                    uint16_t height,
-                                   const char *FourCC,
+                                   char FourCC[][4],
                                    size_t maxlen);
 
 size_t camera_generate_descriptor_dfu(uint8_t *pConf,
@@ -16,4 +17,19 @@ size_t camera_generate_descriptor_dfu(uint8_t *pConf,
 uint8_t *camera_get_video_descriptor(size_t *len);
 uint8_t *camera_get_dfu_descriptor(size_t *len);
 
+struct camera_alt_setting_s {
+    uint16_t packet_size;   // bytes per transaction
+    uint8_t mult;           // transactions per microframe
+};
+
+unsigned camera_frame_binning(uint8_t frame_index);
+unsigned camera_format_bits(uint8_t format_index);
+bool camera_format_compressed(uint8_t format_index);
+uint32_t camera_frame_size(uint8_t format_index, uint16_t width, uint16_t height);
+const struct camera_alt_setting_s *camera_get_alt_setting(uint8_t alt);
+uint32_t camera_alt_payload_size(uint8_t alt);
+uint8_t camera_select_alt(uint32_t frame_size, uint32_t frame_interval);
+uint32_t camera_min_frame_interval(uint32_t frame_size);
+
 void camera_fill_probe_control(uint8_t *probe, uint16_t width, uint16_t height);
+void camera_fill_still_probe_control(uint8_t *probe, uint16_t width, uint16_t height);
@@ -9,6 +9,8 @@ struct USBD_CAMERA_handle_t
 {
     int classId;
     uint8_t VS_alt;
+    uint16_t width;     // full frame, without binning
+    uint16_t height;
     bool hidBusy;
     int ep0rx_iface;
     int ep0tx_iface;
@@ -20,8 +22,30 @@ struct USBD_CAMERA_handle_t
 
 #define UVC_INTERVAL(n)                               (10000000U/(n))
 
-#define UVC_MIN_BIT_RATE(w,h,n)                           (w * h * 16U * (n)) /* 16 bit */
-#define UVC_MAX_BIT_RATE(w,h,n)                           (w * h * 16U * (n)) /* 16 bit */
+/* Frame interval limits, 100 ns units */
+#define UVC_DEFAULT_FRAME_INTERVAL                    UVC_INTERVAL(UVC_CAM_FPS_HS)
+#define UVC_MIN_FRAME_INTERVAL                        UVC_INTERVAL(UVC_CAM_FPS_HS)
+#define UVC_MAX_FRAME_INTERVAL                        100000000U   /* 10 s */
+#define UVC_FRAME_INTERVAL_STEP                       1250U        /* 125 us */
+#define UVC_MICROFRAME_INTERVAL                       1250U        /* 125 us */
+
+/* binned frame has bin*bin less pixels and is streamed that much faster */
+#define UVC_BINNED_INTERVAL(interval, bin)            ((interval) / ((bin) * (bin)))
+
+#define UVC_MIN_BIT_RATE(w,h,bits,n)                      ((w) * (h) * (bits) * (n))
+#define UVC_MAX_BIT_RATE(w,h,bits,n)                      ((w) * (h) * (bits) * (n))
+
+/* packed formats hold whole pixel groups per row, so width*bits is byte aligned */
+#define UVC_FRAME_SIZE(w,h,bits)                          ((w) * (h) * (bits) / 8U)
+
+/*
+ * Rice compressed frame is never larger than Y16 plus 4 bit header
+ * of each block and byte padding of each row
+ */
+#define UVC_RICE_FRAME_SIZE(w,h)                          ((h) * ((w) * 2U + ((w) + 2U * CAMERA_UVC_RICE_BLOCK - 1U) / (2U * CAMERA_UVC_RICE_BLOCK)))
+
+/* compression ratio assumed when bandwidth is reserved for Rice compressed format */
+#define UVC_RICE_EXPECTED_RATIO                           2U
 
 #define WBVAL(x) ((x) & 0xFFU),(((x) >> 8) & 0xFFU)
 #define DBVAL(x) ((x) & 0xFFU),(((x) >> 8) & 0xFFU), (((x) >> 16) & 0xFFU), (((x) >> 24) & 0xFFU)
@@ -43,10 +67,25 @@ uint8_t CDC_DATA_DataIn(struct _USBD_HandleTypeDef *pdev, uint8_t epnum);
 uint8_t CDC_DATA_DataOut(struct _USBD_HandleTypeDef *pdev, uint8_t epnum);
 
 
+uint8_t GUIDE_Init(struct _USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+void GUIDE_DeInit(struct _USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+uint8_t GUIDE_DataIn(struct _USBD_HandleTypeDef *pdev, uint8_t epnum);
+
+
+uint8_t RAW_Init(struct _USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+void RAW_DeInit(struct _USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+void RAW_Setup(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
+uint8_t RAW_EP0_RxReady(struct _USBD_HandleTypeDef *pdev);
+uint8_t RAW_DataIn(struct _USBD_HandleTypeDef *pdev, uint8_t epnum);
+uint8_t RAW_SOF(struct _USBD_HandleTypeDef *pdev);
+
+
+void VS_Init(struct _USBD_HandleTypeDef *pdev);
 void VS_Setup(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
 uint8_t VS_DataIn(struct _USBD_HandleTypeDef *pdev, uint8_t epnum);
 uint8_t VS_SOF(struct _USBD_HandleTypeDef *pdev);
 uint8_t VS_IsoINIncomplete(struct _USBD_HandleTypeDef *pdev, uint8_t epnum);
+uint8_t VS_EP0_RxReady(struct _USBD_HandleTypeDef *pdev);
 
 
 void VC_Setup(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
@@ -68,3 +107,5 @@ extern uint8_t USBD_CAMERA_HID_Report[256];
 extern uint8_t USBD_CAMERA_CfgDesc[CAMERA_DESC_BUFLEN];
 extern uint8_t video_Probe_Control[48];
 extern uint8_t video_Commit_Control[48];
+extern uint8_t video_Still_Probe_Control[USBD_DMA_ALIGN(11U)];
+extern uint8_t video_Still_Commit_Control[USBD_DMA_ALIGN(11U)];
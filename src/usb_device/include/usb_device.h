@@ -12,22 +12,163 @@ extern "C"
 
 struct usb_context_s;
 
-struct usb_context_s* USB_DEVICE_Init(unsigned fps, unsigned width, unsigned height, const char *FourCC);
+/*
+ * Frame metadata, sent after the standard header of the first UVC payload
+ * of each frame (bHeaderLength is 12 + sizeof). Little endian
+ */
+#define FRAME_METADATA_VERSION      1U
+
+#define FRAME_METADATA_TEC          0x01U
+#define FRAME_METADATA_FAN          0x02U
+#define FRAME_METADATA_STILL        0x04U
+#define FRAME_METADATA_TRIGGERED    0x08U   // started by external trigger
+#define FRAME_METADATA_STACKED      0x10U   // stack of frames, exposure is their sum
+
+struct __attribute__((packed)) frame_metadata_s {
+    uint8_t version;                // 0 when frame has no metadata
+    uint8_t flags;
+    uint16_t gain;
+    uint32_t sequence;              // number of exposure
+    uint64_t exposure;              // us
+    uint32_t exposure_start;        // device clock, same as PTS
+    uint32_t exposure_end;
+    uint16_t temperature;           // sensor, 0.1 K
+    uint16_t window_temperature;    // 0.1 K
+    uint16_t target_temperature;    // 0.1 K
+    uint8_t window_heater;
+    uint8_t trigger_mode;
+    uint32_t dropped;               // frames dropped by queue so far
+};
+
+/*
+ * Guide report, sent on the guide interrupt endpoint for each frame taken
+ * while guide ROIs are set: header and one star per ROI, in ROI order.
+ * Coordinates are in full frame pixels, centre of pixel (0, 0) is 0.0
+ */
+struct __attribute__((packed)) guide_star_s {
+    uint32_t x;                     // 1/256 pixel
+    uint32_t y;                     // 1/256 pixel
+    uint32_t flux;                  // ADU above background
+    uint16_t background;            // ADU
+    uint16_t snr;                   // 1/16, 0 when no star is found
+};
+
+struct __attribute__((packed)) guide_report_s {
+    uint32_t sequence;              // number of exposure
+    uint32_t exposure_start;        // device clock, same as PTS
+    struct guide_star_s stars[CAMERA_GUIDE_MAX_ROIS];
+};
+
+/*
+ * Raw frame header, first CAMERA_RAW_HEADER_LEN bytes of each transfer on
+ * the raw bulk endpoint, zero padded. size bytes of frame data follow:
+ * width x height Y16 pixels as stored in SRAM, without hot pixel
+ * correction. A resend carries size bytes from offset of the frame.
+ * Little endian
+ */
+#define RAW_FRAME_MAGIC             0x57415243U     // "CRAW"
+#define RAW_FRAME_VERSION           1U
+
+#define RAW_FRAME_RESENT            0x0001U     // range asked by RAW resend request
+#define RAW_FRAME_GONE              0x0002U     // frame is overwritten or range is wrong, no data
+
+struct __attribute__((packed)) raw_frame_header_s {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_len;            // CAMERA_RAW_HEADER_LEN
+    uint16_t width;
+    uint16_t height;
+    uint16_t bits;                  // 16
+    uint16_t flags;                 // RAW_FRAME_*
+    uint32_t size;                  // bytes of frame data after the header
+    struct frame_metadata_s metadata;
+    uint32_t offset;                // of the data in frame, 0 for whole frames
+};
+
+/* FourCC holds CAMERA_UVC_NUM_FORMATS codes: Y16, packed 12 bit, packed 10 bit, Rice compressed */
+struct usb_context_s* USB_DEVICE_Init(unsigned fps, unsigned width, unsigned height, const char *const FourCC[]);
 struct usb_context_s* USB_DEVICE_Init_DFU(void);
 
+/* DWT cycles spent in OTG HS interrupt and number of interrupts, both wrap */
+void USB_DEVICE_GetIrqLoad(uint32_t *cycles, uint32_t *count);
+
 uint8_t send_current_temperature(int16_t current_temperature);
 uint8_t send_power_settings(bool TEC, bool fan, int window_heater);
 uint8_t send_shutter(bool exposure);
 uint8_t send_serial_data(const uint8_t *data, size_t len);
+uint8_t send_guide_report(const struct guide_report_s *report, unsigned stars);
+uint8_t frame_chunk_filled(bool ok);
+uint8_t frame_chunk_filled_size(size_t len, bool eof);
+uint8_t frame_set_pts(uint32_t pts);
+uint8_t frame_set_metadata(const struct frame_metadata_s *metadata);
+uint8_t frame_still_ready(void);
 
 struct usb_context_s {
     uint8_t (*serial_data)(const uint8_t *data, size_t len);
 
+    /* Start asynchronous read of the streamed frame, finish with frame_chunk_filled() */
+    uint8_t (*read_frame)(uint32_t offset, uint8_t *buf, size_t len);
+
+    /*
+     * Zero-copy bulk payloads: map_frame gives the address of a range of
+     * the frame picked by read_frame, when it is sent as is from SRAM.
+     * set_mapped switches SRAM to memory-mapped mode for the transfer,
+     * USBD_BUSY while another read is running
+     */
+    uint8_t (*map_frame)(uint32_t offset, size_t len, const uint8_t **data);
+    uint8_t (*set_mapped)(bool mapped);
+
+    /*
+     * Raw bulk interface, started and stopped by host. raw_next_frame
+     * fills the header and gives the frame in memory-mapped SRAM,
+     * USBD_BUSY while no frame is queued. raw_frame_done gives it back.
+     * raw_resend_frame does the same for length bytes at offset of the
+     * frame with given sequence (0 length up to the end), header says
+     * when it is gone
+     */
+    uint8_t (*raw_start)(void);
+    uint8_t (*raw_stop)(void);
+    uint8_t (*raw_next_frame)(struct raw_frame_header_s *header, const uint8_t **data, uint32_t *size);
+    uint8_t (*raw_resend_frame)(struct raw_frame_header_s *header, uint32_t sequence, uint32_t offset,
+                                uint32_t length, const uint8_t **data, uint32_t *size);
+    uint8_t (*raw_frame_done)(void);
+
+    /* Video streaming is started and stopped by host */
+    uint8_t (*start_stream)(void);
+    uint8_t (*stop_stream)(void);
+
+    /* Device clock for SCR, CAMERA_UVC_CLOCK_FREQUENCY */
+    uint8_t (*get_timestamp)(uint32_t *timestamp);
+
+    /* Binning of frames read by read_frame: 1, 2 or 4 */
+    uint8_t (*set_binning)(unsigned binning);
+
+    /* Bits per pixel of frames read by read_frame: 16, packed 12 or packed 10, set after binning */
+    uint8_t (*set_packing)(unsigned bits);
+
+    /*
+     * Stream Rice compressed frames: read_frame fills up to len bytes and
+     * finishes with frame_chunk_filled_size(), eof set on the last chunk
+     */
+    uint8_t (*set_compression)(bool compressed);
+
+    /*
+     * Still image: start one exposure, report end of its readout with
+     * frame_still_ready(). still_done is called when the frame is sent
+     */
+    uint8_t (*still_trigger)(void);
+    uint8_t (*still_done)(void);
+
     uint8_t (*set_gain)(unsigned gain);
     uint8_t (*get_gain)(unsigned *gain);
 
+    /* UVC exposure time, 100 us units */
     uint8_t (*set_exposure)(uint32_t exposure);
     uint8_t (*get_exposure)(uint32_t *exposure);
+
+    /* Fine exposure time by XU, us */
+    uint8_t (*set_exposure_us)(uint32_t exposure);
+    uint8_t (*get_exposure_us)(uint32_t *exposure);
     
     uint8_t (*set_fan)(unsigned fan);
     uint8_t (*get_fan)(unsigned *fan);
@@ -41,6 +182,27 @@ struct usb_context_s {
     uint8_t (*set_trigger_mode)(unsigned trigger_mode);
     uint8_t (*get_trigger_mode)(unsigned *trigger_mode);
 
+    /* Trigger to shutter latency ns: last, min, max, and number of triggers */
+    uint8_t (*get_trigger_latency)(uint32_t latency[4]);
+
+    /* Statistics of the last streamed frame: sequence, pixels, min, max, mean, saturated */
+    uint8_t (*get_frame_stats)(uint32_t stats[6]);
+    uint8_t (*get_frame_histogram)(uint32_t histogram[CAMERA_STATS_BINS]);
+
+    /* Auto exposure: VC_AE_MODE_* and target ADU at percentile of the frame */
+    uint8_t (*set_ae_mode)(unsigned mode);
+    uint8_t (*get_ae_mode)(unsigned *mode);
+    uint8_t (*set_ae_target)(unsigned target, unsigned percentile);
+    uint8_t (*get_ae_target)(unsigned *target, unsigned *percentile);
+
+    /* Guide ROIs: count (0 stops guiding), side and centres x, y in full frame pixels */
+    uint8_t (*set_guide_rois)(unsigned count, unsigned size, uint16_t centers[][2]);
+    uint8_t (*get_guide_rois)(unsigned *count, unsigned *size, uint16_t centers[][2]);
+
+    /* Stacking: depth frames (0 or 1 - off), VC_STACK_* flags, output is sum >> shift */
+    uint8_t (*set_stack)(unsigned depth, unsigned flags, unsigned shift);
+    uint8_t (*get_stack)(unsigned *depth, unsigned *flags, unsigned *shift);
+
     uint8_t (*set_target_temperature)(unsigned temperature);
     uint8_t (*get_target_temperature)(unsigned *temperature);
 
@@ -28,6 +28,9 @@ extern USBD_HandleTypeDef hUsbDeviceHS;
 __ALIGN_BEGIN uint8_t USBD_CAMERA_CfgDesc[CAMERA_DESC_BUFLEN] __ALIGN_END;
 __ALIGN_BEGIN uint8_t video_Probe_Control[48] __ALIGN_END;
 __ALIGN_BEGIN uint8_t video_Commit_Control[48] __ALIGN_END;
+// padded to words, OTG DMA writes received data by words
+__ALIGN_BEGIN uint8_t video_Still_Probe_Control[USBD_DMA_ALIGN(11U)] __ALIGN_END;
+__ALIGN_BEGIN uint8_t video_Still_Commit_Control[USBD_DMA_ALIGN(11U)] __ALIGN_END;
 
 __ALIGN_BEGIN static uint8_t USBD_CAMERA_DeviceQualifierDesc[USB_LEN_DEV_QUALIFIER_DESC] __ALIGN_END =
     {
@@ -67,21 +70,20 @@ static struct
     uint8_t fps;
     uint16_t width;
     uint16_t height;
-    char FourCC[4];
+    char FourCC[CAMERA_UVC_NUM_FORMATS][4];
 } USBD_CAMERA_Config;
 
 struct USBD_CAMERA_handle_t USBD_CAMERA_handle;
 
-uint8_t USBD_CAMERA_Configure(unsigned fps, unsigned width, unsigned height, const char *FourCC)
+uint8_t USBD_CAMERA_Configure(unsigned fps, unsigned width, unsigned height, const char *const FourCC[])
 {
     USBD_CAMERA_handle.dfu_mode = false;
     USBD_CAMERA_Config.fps = fps;
     USBD_CAMERA_Config.width = width;
     USBD_CAMERA_Config.height = height;
-    USBD_CAMERA_Config.FourCC[0] = FourCC[0];
-    USBD_CAMERA_Config.FourCC[1] = FourCC[1];
-    USBD_CAMERA_Config.FourCC[2] = FourCC[2];
-    USBD_CAMERA_Config.FourCC[3] = FourCC[3];
+    unsigned format;
+    for (format = 0; format < CAMERA_UVC_NUM_FORMATS; format++)
+        memcpy(USBD_CAMERA_Config.FourCC[format], FourCC[format], 4);
     ssize_t len = camera_generate_descriptor(USBD_CAMERA_CfgDesc,
                                              USBD_CAMERA_Config.fps,
                                              USBD_CAMERA_Config.width,
@@ -93,8 +95,13 @@ uint8_t USBD_CAMERA_Configure(unsigned fps, unsigned width, unsigned height, con
         return USBD_FAIL;
 
     USBD_CAMERA_CfgDesc_len = len;
+    USBD_CAMERA_handle.width = width;
+    USBD_CAMERA_handle.height = height;
 
     camera_fill_probe_control(video_Probe_Control, USBD_CAMERA_Config.width, USBD_CAMERA_Config.height);
+    camera_fill_probe_control(video_Commit_Control, USBD_CAMERA_Config.width, USBD_CAMERA_Config.height);
+    camera_fill_still_probe_control(video_Still_Probe_Control, USBD_CAMERA_Config.width, USBD_CAMERA_Config.height);
+    camera_fill_still_probe_control(video_Still_Commit_Control, USBD_CAMERA_Config.width, USBD_CAMERA_Config.height);
     return (uint8_t)USBD_OK;
 }
 
@@ -117,7 +124,11 @@ static uint8_t USBD_CAMERA_Init(struct _USBD_HandleTypeDef *pdev, uint8_t cfgidx
     } else {
         CDC_ACM_Init(pdev, cfgidx);
         CDC_DATA_Init(pdev, cfgidx);
-        USBD_CAMERA_handle.VS_alt = 0x00U;
+        GUIDE_Init(pdev, cfgidx);
+#if CAMERA_RAW_ENABLE
+        RAW_Init(pdev, cfgidx);
+#endif
+        VS_Init(pdev);
     }
 
     USBD_CAMERA_handle.ep0rx_iface = -1;
@@ -148,6 +159,16 @@ static uint8_t USBD_CAMERA_DeInit(struct _USBD_HandleTypeDef *pdev, uint8_t cfgi
             USBD_LL_CloseEP(pdev, CAMERA_CDC_DATA_EPOUT);
             pdev->ep_in[CAMERA_CDC_DATA_EPOUT & 0xFU].is_used = 0U;
         }
+        if (pdev->ep_in[CAMERA_GUIDE_EPIN & 0xFU].is_used)
+        {
+            GUIDE_DeInit(pdev, cfgidx);
+        }
+#if CAMERA_RAW_ENABLE
+        if (pdev->ep_in[CAMERA_RAW_EPIN & 0xFU].is_used)
+        {
+            RAW_DeInit(pdev, cfgidx);
+        }
+#endif
     }
     return (uint8_t)USBD_OK;
 }
@@ -167,6 +188,13 @@ static uint8_t USBD_CAMERA_Setup(struct _USBD_HandleTypeDef *pdev, USBD_SetupReq
         default:
             break;
         }
+    } else if (requestRecipicient == USB_REQ_RECIPIENT_ENDPOINT) {
+        if (LOBYTE(req->wIndex) == CAMERA_UVC_EPIN)
+            VS_Setup(pdev, req);
+#if CAMERA_RAW_ENABLE
+        else if (LOBYTE(req->wIndex) == CAMERA_RAW_EPIN)
+            RAW_Setup(pdev, req);
+#endif
     } else {
         switch (LOBYTE(req->wIndex))
         {
@@ -185,6 +213,11 @@ static uint8_t USBD_CAMERA_Setup(struct _USBD_HandleTypeDef *pdev, USBD_SetupReq
         case CAMERA_CDC_DATA_INTERFACE_ID:
             CDC_DATA_Setup(pdev, req);
             break;
+#if CAMERA_RAW_ENABLE
+        case CAMERA_RAW_INTERFACE_ID:
+            RAW_Setup(pdev, req);
+            break;
+#endif
         default:
             break;
         }
@@ -196,6 +229,9 @@ static uint8_t USBD_CAMERA_SOF(struct _USBD_HandleTypeDef *pdev)
 {
     if (!USBD_CAMERA_handle.dfu_mode) {
         VS_SOF(pdev);
+#if CAMERA_RAW_ENABLE
+        RAW_SOF(pdev);
+#endif
     }
     DFU_SOF(pdev);
     return USBD_OK;
@@ -218,6 +254,7 @@ static uint8_t USBD_CAMERA_EP0_RxReady(USBD_HandleTypeDef *pdev)
         switch (USBD_CAMERA_handle.ep0rx_iface)
         {
         case CAMERA_VS_INTERFACE_ID:
+            res = VS_EP0_RxReady(pdev);
             break;
         case CAMERA_VC_INTERFACE_ID:
             res = VC_EP0_RxReady(pdev);
@@ -230,6 +267,11 @@ static uint8_t USBD_CAMERA_EP0_RxReady(USBD_HandleTypeDef *pdev)
             break;
         case CAMERA_CDC_DATA_INTERFACE_ID:
             break;
+#if CAMERA_RAW_ENABLE
+        case CAMERA_RAW_INTERFACE_ID:
+            res = RAW_EP0_RxReady(pdev);
+            break;
+#endif
         default:
             res = USBD_FAIL;
             break;
@@ -254,6 +296,14 @@ static uint8_t USBD_CAMERA_DataIn(struct _USBD_HandleTypeDef *pdev, uint8_t epnu
         case EPNUM(CAMERA_CDC_DATA_EPIN):
             CDC_DATA_DataIn(pdev, epnum);
             break;
+        case EPNUM(CAMERA_GUIDE_EPIN):
+            GUIDE_DataIn(pdev, epnum);
+            break;
+#if CAMERA_RAW_ENABLE
+        case EPNUM(CAMERA_RAW_EPIN):
+            RAW_DataIn(pdev, epnum);
+            break;
+#endif
         }
     }
     return (uint8_t)USBD_OK;
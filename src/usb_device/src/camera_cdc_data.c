@@ -8,8 +8,8 @@
 
 
 static struct {
-    uint8_t rxbuf[CAMERA_CDC_DATA_EPOUT_SIZE];
-    uint8_t txbuf[CAMERA_CDC_DATA_EPIN_SIZE];
+    __ALIGN_BEGIN uint8_t rxbuf[CAMERA_CDC_DATA_EPOUT_SIZE] __ALIGN_END;
+    __ALIGN_BEGIN uint8_t txbuf[CAMERA_CDC_DATA_EPIN_SIZE] __ALIGN_END;
     size_t txbuf_len;
     bool busy;
 } cdc_data_state;
@@ -14,6 +14,9 @@
 #define VS_COLORFORMAT                                  0x0DU
 #define VS_FORMAT_UNCOMPRESSED                          0x04U
 #define VS_FRAME_UNCOMPRESSED                           0x05U
+#define VS_STILL_IMAGE_FRAME                            0x03U
+#define VS_FORMAT_FRAME_BASED                           0x10U
+#define VS_FRAME_FRAME_BASED                            0x11U
 
 #define VC_HEADER                                     0x01U
 #define VC_INPUT_TERMINAL                             0x02U
@@ -21,6 +24,7 @@
 #define VC_PROCESSING_TERMINAL                        0x05U
 #define VC_XU_TERMINAL                                0x06U
 
+#define VC_CAMERA_AE_MODE                               (1U << 1)
 #define VC_CAMERA_ABSOLUTE_TIME                         (1U << 3)
 #define VC_PROCESSING_GAIN                              (1U << 9)
 
@@ -31,6 +35,13 @@
 #define XU_CURRENT_TEMPERATURE                          (1U << 4)
 #define XU_WINDOW_TEMPERATURE                           (1U << 5)
 #define XU_TRIGGER_MODE                                 (1U << 6)
+#define XU_EXPOSURE                                     (1U << 7)
+#define XU_TRIGGER_LATENCY                              (1U << 8)
+#define XU_FRAME_STATS                                  (1U << 9)
+#define XU_FRAME_HISTOGRAM                              (1U << 10)
+#define XU_AE_TARGET                                    (1U << 11)
+#define XU_GUIDE_ROI                                    (1U << 12)
+#define XU_STACK                                        (1U << 13)
 
 #define TT_STREAMING                                   0x0101U
 #define ITT_CAMERA                                     0x0201U
@@ -42,6 +53,7 @@
 #define CDC_ACM_SUBCLASS                                0x02U
 #define CDC_ACM_PROTOCOL                                0x00U
 #define CDC_DATA_CLASS                                  0x0AU
+#define VENDOR_CLASS                                    0xFFU
 
 
 #define USBD_EP_SYNCH_NONE      0x00U
@@ -51,6 +63,40 @@
 
 #define PC_PROTOCOL_UNDEFINED                           0x00U
 
+/* wMaxPacketSize bits 12..11 hold additional transactions per microframe */
+#define UVC_EP_MAX_PACKET(size, mult)                   ((size) | (((mult) - 1U) << 11))
+
+/* Binning of frame descriptors 1..CAMERA_UVC_NUM_FRAMES */
+static const uint8_t frame_binning[CAMERA_UVC_NUM_FRAMES] = {1U, 2U, 4U};
+
+/* Format descriptors 1..CAMERA_UVC_NUM_FORMATS */
+static const struct {
+    uint8_t bits;       // bits per pixel, before compression
+    bool compressed;    // frame based format with variable frame size
+} formats[CAMERA_UVC_NUM_FORMATS] = {
+    {UVC_BITS_PER_PIXEL, false},
+    {12U, false},
+    {10U, false},
+    {UVC_BITS_PER_PIXEL, true},
+};
+
+#if !CAMERA_UVC_BULK
+/*
+ * Isochronous bandwidth of VS alternate settings 1..CAMERA_UVC_NUM_ALTS,
+ * increasing, so the host can reserve only what the stream needs
+ */
+static const struct camera_alt_setting_s alt_settings[CAMERA_UVC_NUM_ALTS] = {
+    {128U,  1U},
+    {256U,  1U},
+    {512U,  1U},
+    {1024U, 1U},
+#if CAMERA_UVC_EPIN_MULT > 2U
+    {1024U, 2U},
+#endif
+    {CAMERA_UVC_EPIN_SIZE, CAMERA_UVC_EPIN_MULT},
+};
+#endif
+
 static const uint8_t classSpecificInterfaceDescriptorVC[] = {
     0x0DU,                  // bLength
     CS_INTERFACE,           // bDescriptorType
@@ -79,7 +125,7 @@ ssize_t camera_generate_descriptor(uint8_t *pConf,
                                    uint8_t fps,
                                    uint16_t width,
                                    uint16_t height,
-                                   const char *FourCC,
+                                   char FourCC[][4],
                                    size_t maxlen)
 {
     ssize_t size = 0;
@@ -181,7 +227,7 @@ ssize_t camera_generate_descriptor(uint8_t *pConf,
                 WBVAL(0),          // wObjectiveFocalLengthMax
                 WBVAL(0),          // wOcularFocalLength
                 0x02U,             // bControlSize
-                WBVAL(VC_CAMERA_ABSOLUTE_TIME), // bmControls
+                WBVAL(VC_CAMERA_AE_MODE | VC_CAMERA_ABSOLUTE_TIME), // bmControls
             };
             if (size + sizeof(inputTerminalDescriptor) > maxlen)
                 return -1;
@@ -241,14 +287,21 @@ ssize_t camera_generate_descriptor(uint8_t *pConf,
                 0x9c,0x62,0x38,0x4d,
                 0xb5,0x2a,0x2a,0xf4,
                 0x30,0x52,0x3f,0xd5,
-                0x07U,               // bNumControls
+                0x0EU,               // bNumControls
                 0x00U,               // bNrInPins
                 0x02U,               // bControlSize
                 WBVAL(XU_FAN | XU_TEC | XU_WINDOW_HEATER |
                       XU_TARGET_TEMPERATURE |
                       XU_CURRENT_TEMPERATURE |
                       XU_WINDOW_TEMPERATURE |
-                      XU_TRIGGER_MODE),
+                      XU_TRIGGER_MODE |
+                      XU_EXPOSURE |
+                      XU_TRIGGER_LATENCY |
+                      XU_FRAME_STATS |
+                      XU_FRAME_HISTOGRAM |
+                      XU_AE_TARGET |
+                      XU_GUIDE_ROI |
+                      XU_STACK),
                 0x00U,               // iExtension
             };
             if (size + sizeof(xuTerminalDescriptor) > maxlen)
@@ -277,7 +330,7 @@ ssize_t camera_generate_descriptor(uint8_t *pConf,
                 USB_DESC_TYPE_INTERFACE,                // bDescriptorType
                 CAMERA_VS_INTERFACE_ID,                 // bInterfaceNumber
                 0x00U,                                  // bAlternateSetting
-                0x00U,                                  // bNumEndpoints
+                CAMERA_UVC_BULK ? 0x01U : 0x00U,        // bNumEndpoints
                 UVC_CC_VIDEO,                           // bInterfaceClass
                 0x02U,                                  // bInterfaceSubClass
                 PC_PROTOCOL_UNDEFINED,                  // bInterfaceProtocol
@@ -292,19 +345,22 @@ ssize_t camera_generate_descriptor(uint8_t *pConf,
 
         {
             const uint8_t classSpecificInterfaceDescriptorVS[] = {
-                0x0EU,           // bLength
+                0x0DU + CAMERA_UVC_NUM_FORMATS, // bLength
                 CS_INTERFACE,    // bDescriptorType
                 VS_INPUT_HEADER, // bDescriptorSubtype
-                0x01U,           // bNumFormats
+                CAMERA_UVC_NUM_FORMATS, // bNumFormats
                 WBVAL(0),        // wTotalLength --- UPDATE LATER!
                 CAMERA_UVC_EPIN, // bEndpointAddress
                 0x00U,           // bmInfo
                 0x03U,           // bTerminalLink
-                0x01U,           // bStillCaptureMethod
+                0x02U,           // bStillCaptureMethod, still frames on video endpoint
                 0x01U,           // bTriggerSupport
-                0x00U,           // bTriggerUsage
+                0x00U,           // bTriggerUsage, trigger starts still capture
                 0x01U,           // bControlSize
-                0x00U,           // bmaControls
+                0x00U,           // bmaControls(1), Y16
+                0x00U,           // bmaControls(2), packed 12 bit
+                0x00U,           // bmaControls(3), packed 10 bit
+                0x00U,           // bmaControls(4), Rice compressed
             };
             if (size + sizeof(classSpecificInterfaceDescriptorVS) > maxlen)
                 return -1;
@@ -317,92 +373,222 @@ ssize_t camera_generate_descriptor(uint8_t *pConf,
             wTotalLengthVS += sizeof(classSpecificInterfaceDescriptorVS);
         }
 
+        uint8_t format;
+        for (format = 1; format <= CAMERA_UVC_NUM_FORMATS; format++)
         {
-            const uint8_t formatDescriptor[] = {
-                0x1BU,                  // bLength
-                CS_INTERFACE,           // bDescriptorType
-                VS_FORMAT_UNCOMPRESSED, // bDescriptorSubtype
-                0x01U,                  // bFormatIndex
-                0x01U,                  // bNumFrameDescriptors
+            const unsigned bits = camera_format_bits(format);
+            const bool compressed = camera_format_compressed(format);
+            const char *fourcc = FourCC[format - 1];
+            if (compressed) {
+                const uint8_t formatDescriptor[] = {
+                    0x1CU,                  // bLength
+                    CS_INTERFACE,           // bDescriptorType
+                    VS_FORMAT_FRAME_BASED,  // bDescriptorSubtype
+                    format,                 // bFormatIndex
+                    CAMERA_UVC_NUM_FRAMES,  // bNumFrameDescriptors
+
+                    fourcc[0], fourcc[1], fourcc[2], fourcc[3], // GUID
+                    0x00U, 0x00U,
+                    0x10U, 0x00U,
+                    0x80U, 0x00U,
+                    0x00U, 0xAAU, 0x00U, 0x38U, 0x9BU, 0x71U,
+                    bits,               // bBitsPerPixel
+
+                    0x01U, // bDefaultFrameIndex
+                    0x00U, // bAspectRatioX
+                    0x00U, // bAspectRatioY
+                    0x00U, // bmInterlaceFlags
+                    0x00U, // bCopyProtect
+                    0x01U, // bVariableSize
+                };
+                if (size + sizeof(formatDescriptor) > maxlen)
+                    return -1;
+                if (pConf != NULL)
+                    memcpy(pConf + size, formatDescriptor, sizeof(formatDescriptor));
+                size += sizeof(formatDescriptor);
+                wTotalLengthVS += sizeof(formatDescriptor);
+            } else {
+                const uint8_t formatDescriptor[] = {
+                    0x1BU,                  // bLength
+                    CS_INTERFACE,           // bDescriptorType
+                    VS_FORMAT_UNCOMPRESSED, // bDescriptorSubtype
+                    format,                 // bFormatIndex
+                    CAMERA_UVC_NUM_FRAMES,  // bNumFrameDescriptors
+
+                    fourcc[0], fourcc[1], fourcc[2], fourcc[3], // GUID
+                    0x00U, 0x00U,
+                    0x10U, 0x00U,
+                    0x80U, 0x00U,
+                    0x00U, 0xAAU, 0x00U, 0x38U, 0x9BU, 0x71U,
+                    bits,               // bBitsPerPixel
+
+                    0x01U, // bDefaultFrameIndex
+                    0x00U, // bAspectRatioX
+                    0x00U, // bAspectRatioY
+                    0x00U, // bmInterlaceFlags
+                    0x00U, // bCopyProtect
+                };
+                if (size + sizeof(formatDescriptor) > maxlen)
+                    return -1;
+                if (pConf != NULL)
+                    memcpy(pConf + size, formatDescriptor, sizeof(formatDescriptor));
+                size += sizeof(formatDescriptor);
+                wTotalLengthVS += sizeof(formatDescriptor);
+            }
 
-                FourCC[0], FourCC[1], FourCC[2], FourCC[3], // GUID
-                0x00U, 0x00U,
-                0x10U, 0x00U,
-                0x80U, 0x00U,
-                0x00U, 0xAAU, 0x00U, 0x38U, 0x9BU, 0x71U,
-                UVC_BITS_PER_PIXEL, // bBitsPerPixel
+            uint8_t frame;
+            for (frame = 1; frame <= CAMERA_UVC_NUM_FRAMES; frame++)
+            {
+                const unsigned bin = camera_frame_binning(frame);
+                const unsigned w = width / bin;
+                const unsigned h = height / bin;
+                if (compressed) {
+                    const uint8_t frameDescriptor[] = {
+                        0x26U,                                          // bLength
+                        CS_INTERFACE,                                   // bDescriptorType
+                        VS_FRAME_FRAME_BASED,                           // bDescriptorSubtype
+                        frame,                                          // bFrameIndex
+                        0x03,                                           // bmCapabilities
+                        WBVAL(w),                                       // wWidth
+                        WBVAL(h),                                       // wHeight
+                        DBVAL(UVC_MIN_BIT_RATE(w, h, bits, fps * bin * bin) / UVC_RICE_EXPECTED_RATIO), // dwMinBitRate
+                        DBVAL(UVC_MAX_BIT_RATE(w, h, bits, fps * bin * bin)), // dwMaxBitRate
+                        DBVAL(UVC_BINNED_INTERVAL(UVC_DEFAULT_FRAME_INTERVAL, bin)), // dwDefaultFrameInterval
+                        0x00,                                           // bFrameIntervalType
+                        DBVAL(0U),                                      // dwBytesPerLine, variable
+                        DBVAL(UVC_BINNED_INTERVAL(UVC_MIN_FRAME_INTERVAL, bin)),     // dwMinFrameInterval
+                        DBVAL(UVC_MAX_FRAME_INTERVAL),                  // dwMaxFrameInterval
+                        DBVAL(UVC_FRAME_INTERVAL_STEP),                 // dwFrameIntervalStep
+                    };
+                    if (size + sizeof(frameDescriptor) > maxlen)
+                        return -1;
+                    if (pConf != NULL)
+                        memcpy(pConf + size, frameDescriptor, sizeof(frameDescriptor));
+                    size += sizeof(frameDescriptor);
+                    wTotalLengthVS += sizeof(frameDescriptor);
+                } else {
+                    const uint8_t frameDescriptor[] = {
+                        0x26U,                                          // bLength
+                        CS_INTERFACE,                                   // bDescriptorType
+                        VS_FRAME_UNCOMPRESSED,                          // bDescriptorSubtype
+                        frame,                                          // bFrameIndex
+                        0x03,                                           // bmCapabilities
+                        WBVAL(w),                                       // wWidth
+                        WBVAL(h),                                       // wHeight
+                        DBVAL(UVC_MIN_BIT_RATE(w, h, bits, fps * bin * bin)), // dwMinBitRate
+                        DBVAL(UVC_MAX_BIT_RATE(w, h, bits, fps * bin * bin)), // dwMaxBitRate
+                        DBVAL(UVC_FRAME_SIZE(w, h, bits)),              // dwMaxVideoFrameBufSize
+                        DBVAL(UVC_BINNED_INTERVAL(UVC_DEFAULT_FRAME_INTERVAL, bin)), // dwDefaultFrameInterval
+                        0x00,                                           // bFrameIntervalType
+                        DBVAL(UVC_BINNED_INTERVAL(UVC_MIN_FRAME_INTERVAL, bin)),     // dwMinFrameInterval
+                        DBVAL(UVC_MAX_FRAME_INTERVAL),                  // dwMaxFrameInterval
+                        DBVAL(UVC_FRAME_INTERVAL_STEP),                 // dwFrameIntervalStep
+                    };
+                    if (size + sizeof(frameDescriptor) > maxlen)
+                        return -1;
+                    if (pConf != NULL)
+                        memcpy(pConf + size, frameDescriptor, sizeof(frameDescriptor));
+                    size += sizeof(frameDescriptor);
+                    wTotalLengthVS += sizeof(frameDescriptor);
+                }
+            }
 
-                0x01U, // bDefaultFrameIndex
-                0x00U, // bAspectRatioX
-                0x00U, // bAspectRatioY
-                0x00U, // bmInterlaceFlags
-                0x00U, // bCopyProtect
-            };
-            if (size + sizeof(formatDescriptor) > maxlen)
-                return -1;
-            if (pConf != NULL)
-                memcpy(pConf + size, formatDescriptor, sizeof(formatDescriptor));
-            size += sizeof(formatDescriptor);
-            wTotalLengthVS += sizeof(formatDescriptor);
-        }
-
-        {
-            const uint8_t frameDescriptor[] = {
-                0x26U,                                          // bLength
-                CS_INTERFACE,                                   // bDescriptorType
-                VS_FRAME_UNCOMPRESSED,                          // bDescriptorSubtype
-                0x01,                                           // bFrameIndex
-                0x03,                                           // bmCapabilities
-                WBVAL(width),                                   // wWidth
-                WBVAL(height),                                  // wHeight
-                DBVAL(UVC_MIN_BIT_RATE(width, height, fps)),    // dwMinBitRate
-                DBVAL(UVC_MAX_BIT_RATE(width, height, fps)),    // dwMaxBitRate
-                DBVAL(width * height * 2U),                     // dwMaxVideoFrameBufSize
-                DBVAL(UVC_INTERVAL(UVC_CAM_FPS_HS)),            // dwDefaultFrameInterval
-                0x00,                                           // bFrameIntervalType
-                DBVAL(UVC_INTERVAL(UVC_CAM_FPS_HS)),            // dwMinFrameInterval
-                DBVAL(UVC_INTERVAL(UVC_CAM_FPS_HS)),            // dwMaxFrameInterval
-                DBVAL(0),                                       // dwFrameIntervalStep
-            };
-            if (size + sizeof(frameDescriptor) > maxlen)
-                return -1;
-            if (pConf != NULL)
-                memcpy(pConf + size, frameDescriptor, sizeof(frameDescriptor));
-            size += sizeof(frameDescriptor);
-            wTotalLengthVS += sizeof(frameDescriptor);
-        }
+            {
+                // still image sizes are the binned frame sizes, same order
+                const uint8_t stillImageFrameDescriptor[] = {
+                    0x06U + 4U * CAMERA_UVC_NUM_FRAMES,     // bLength
+                    CS_INTERFACE,                           // bDescriptorType
+                    VS_STILL_IMAGE_FRAME,                   // bDescriptorSubtype
+                    0x00U,                                  // bEndpointAddress, method 2
+                    CAMERA_UVC_NUM_FRAMES,                  // bNumImageSizePatterns
+                };
+                if (size + sizeof(stillImageFrameDescriptor) > maxlen)
+                    return -1;
+                if (pConf != NULL)
+                    memcpy(pConf + size, stillImageFrameDescriptor, sizeof(stillImageFrameDescriptor));
+                size += sizeof(stillImageFrameDescriptor);
+                wTotalLengthVS += sizeof(stillImageFrameDescriptor);
+
+                for (frame = 1; frame <= CAMERA_UVC_NUM_FRAMES; frame++)
+                {
+                    const unsigned bin = camera_frame_binning(frame);
+                    const uint8_t imageSizePattern[] = {
+                        WBVAL(width / bin),                 // wWidth(frame)
+                        WBVAL(height / bin),                // wHeight(frame)
+                    };
+                    if (size + sizeof(imageSizePattern) > maxlen)
+                        return -1;
+                    if (pConf != NULL)
+                        memcpy(pConf + size, imageSizePattern, sizeof(imageSizePattern));
+                    size += sizeof(imageSizePattern);
+                    wTotalLengthVS += sizeof(imageSizePattern);
+                }
+
+                const uint8_t compressionPatterns[] = {
+                    0x00U,                                  // bNumCompressionPattern
+                };
+                if (size + sizeof(compressionPatterns) > maxlen)
+                    return -1;
+                if (pConf != NULL)
+                    memcpy(pConf + size, compressionPatterns, sizeof(compressionPatterns));
+                size += sizeof(compressionPatterns);
+                wTotalLengthVS += sizeof(compressionPatterns);
+            }
 
-        {
-            const uint8_t colorMatchingDescriptor[] = {
-                0x06,                    // bLength
-                CS_INTERFACE,            // bDescriptorType
-                VS_COLORFORMAT,          // bDescriptorSubtype
-                CAMERA_UVC_COLOR_PRIMARIE,      // bColorPrimarie
-                CAMERA_UVC_TFR_CHARACTERISTICS, // bTransferCharacteristics
-                CAMERA_UVC_MATRIX_COEFFICIENTS, // bMatrixCoefficients
-            };
-            if (size + sizeof(colorMatchingDescriptor) > maxlen)
-                return -1;
-            if (pConf != NULL)
-                memcpy(pConf + size, colorMatchingDescriptor, sizeof(colorMatchingDescriptor));
-            size += sizeof(colorMatchingDescriptor);
-            wTotalLengthVS += sizeof(colorMatchingDescriptor);
+            {
+                const uint8_t colorMatchingDescriptor[] = {
+                    0x06,                    // bLength
+                    CS_INTERFACE,            // bDescriptorType
+                    VS_COLORFORMAT,          // bDescriptorSubtype
+                    CAMERA_UVC_COLOR_PRIMARIE,      // bColorPrimarie
+                    CAMERA_UVC_TFR_CHARACTERISTICS, // bTransferCharacteristics
+                    CAMERA_UVC_MATRIX_COEFFICIENTS, // bMatrixCoefficients
+                };
+                if (size + sizeof(colorMatchingDescriptor) > maxlen)
+                    return -1;
+                if (pConf != NULL)
+                    memcpy(pConf + size, colorMatchingDescriptor, sizeof(colorMatchingDescriptor));
+                size += sizeof(colorMatchingDescriptor);
+                wTotalLengthVS += sizeof(colorMatchingDescriptor);
+            }
         }
 
         if (pConf != NULL) {
             *wTotalLengthVS_L = LOBYTE(wTotalLengthVS);
             *wTotalLengthVS_H = HIBYTE(wTotalLengthVS);
         }
+
+#if CAMERA_UVC_BULK
+        {
+            const uint8_t bulkVideoDataEndpointDescriptor[] = {
+                0x07U,                                      // bLength
+                USB_DESC_TYPE_ENDPOINT,                     // bDescriptorType
+                CAMERA_UVC_EPIN,                            // bEndpointAddress
+                USBD_EP_TYPE_BULK,                          // bmAttributes
+                WBVAL(CAMERA_UVC_EPIN_SIZE),                // wMaxPacketSize
+                0x00U,                                      // bInterval
+            };
+            if (size + sizeof(bulkVideoDataEndpointDescriptor) > maxlen)
+                return -1;
+            if (pConf != NULL)
+                memcpy(pConf + size, bulkVideoDataEndpointDescriptor, sizeof(bulkVideoDataEndpointDescriptor));
+            size += sizeof(bulkVideoDataEndpointDescriptor);
+        }
+#endif
     }
 
-    /* UVC VS interface alt 1 */
+#if !CAMERA_UVC_BULK
+    /* UVC VS interface alt 1..N */
+    uint8_t alt;
+    for (alt = 1; alt <= CAMERA_UVC_NUM_ALTS; alt++)
     {
+        const struct camera_alt_setting_s *setting = camera_get_alt_setting(alt);
         {
             const uint8_t interfaceDescriptorVS[] = {
                 0x09U,                                  // bLength
                 USB_DESC_TYPE_INTERFACE,                // bDescriptorType
                 CAMERA_VS_INTERFACE_ID,                 // bInterfaceNumber
-                0x01U,                                  // bAlternateSetting
+                alt,                                    // bAlternateSetting
                 0x01U,                                  // bNumEndpoints
                 UVC_CC_VIDEO,                           // bInterfaceClass
                 0x02U,                                  // bInterfaceSubClass
@@ -422,7 +608,8 @@ ssize_t camera_generate_descriptor(uint8_t *pConf,
                 USB_DESC_TYPE_ENDPOINT,                     // bDescriptorType
                 CAMERA_UVC_EPIN,                            // bEndpointAddress
                 USBD_EP_TYPE_ISOC | USBD_EP_SYNCH_ASYNC,    // bmAttributes
-                WBVAL(CAMERA_UVC_EPIN_SIZE),                // wMaxPacketSize
+                WBVAL(UVC_EP_MAX_PACKET(setting->packet_size,
+                                        setting->mult)),    // wMaxPacketSize
                 0x01U,                                      // bInterval
             };
             if (size + sizeof(isochronousVideoDataEndpointDescriptor) > maxlen)
@@ -432,6 +619,7 @@ ssize_t camera_generate_descriptor(uint8_t *pConf,
             size += sizeof(isochronousVideoDataEndpointDescriptor);
         }
     }
+#endif
 
     /* DFU interface */
     {
@@ -634,6 +822,84 @@ ssize_t camera_generate_descriptor(uint8_t *pConf,
         }
     }
 
+    /* Guide interface */
+    {
+        {
+            const uint8_t interfaceDescriptorGuide[] = {
+                0x09U,                          // bLength
+                USB_DESC_TYPE_INTERFACE,        // bDescriptorType
+                CAMERA_GUIDE_INTERFACE_ID,      // bInterfaceNumber
+                0x00U,                          // bAlternateSetting
+                0x01U,                          // bNumEndpoints
+                VENDOR_CLASS,                   // bInterfaceClass
+                0x00U,                          // bInterfaceSubClass
+                0x00U,                          // bInterfaceProtocol
+                0x00U,                          // iInterface
+            };
+            if (size + sizeof(interfaceDescriptorGuide) > maxlen)
+                return -1;
+            if (pConf != NULL)
+                memcpy(pConf + size, interfaceDescriptorGuide, sizeof(interfaceDescriptorGuide));
+            size += sizeof(interfaceDescriptorGuide);
+        }
+
+        {
+            const uint8_t epInDesc[] = {
+                0x07U,                       // bLength
+                USB_DESC_TYPE_ENDPOINT,      // bDescriptorType
+                CAMERA_GUIDE_EPIN,           // bEndpointAddress
+                USBD_EP_TYPE_INTR,           // bmAttributes
+                WBVAL(CAMERA_GUIDE_EPIN_SIZE), // wMaxPacketSize
+                0x04U,                       // bInterval: 1 ms
+            };
+            if (size + sizeof(epInDesc) > maxlen)
+                return -1;
+            if (pConf != NULL)
+                memcpy(pConf + size, epInDesc, sizeof(epInDesc));
+            size += sizeof(epInDesc);
+        }
+    }
+
+#if CAMERA_RAW_ENABLE
+    /* Raw frame interface */
+    {
+        {
+            const uint8_t interfaceDescriptorRaw[] = {
+                0x09U,                          // bLength
+                USB_DESC_TYPE_INTERFACE,        // bDescriptorType
+                CAMERA_RAW_INTERFACE_ID,        // bInterfaceNumber
+                0x00U,                          // bAlternateSetting
+                0x01U,                          // bNumEndpoints
+                VENDOR_CLASS,                   // bInterfaceClass
+                0x00U,                          // bInterfaceSubClass
+                0x00U,                          // bInterfaceProtocol
+                0x00U,                          // iInterface
+            };
+            if (size + sizeof(interfaceDescriptorRaw) > maxlen)
+                return -1;
+            if (pConf != NULL)
+                memcpy(pConf + size, interfaceDescriptorRaw, sizeof(interfaceDescriptorRaw));
+            size += sizeof(interfaceDescriptorRaw);
+        }
+
+        {
+            const uint8_t epInDesc[] = {
+                0x07U,                       // bLength
+                USB_DESC_TYPE_ENDPOINT,      // bDescriptorType
+                CAMERA_RAW_EPIN,             // bEndpointAddress
+                USBD_EP_TYPE_BULK,           // bmAttributes
+                WBVAL(CAMERA_RAW_EPIN_SIZE), // wMaxPacketSize
+                0x00U,                       // bInterval
+            };
+            if (size + sizeof(epInDesc) > maxlen)
+                return -1;
+            if (pConf != NULL)
+                memcpy(pConf + size, epInDesc, sizeof(epInDesc));
+            size += sizeof(epInDesc);
+        }
+    }
+#endif
+
     if (pConf != NULL) {
         *wTotalLength_L = LOBYTE(size);
         *wTotalLength_H = HIBYTE(size);
@@ -749,21 +1015,114 @@ uint8_t *camera_get_dfu_descriptor(size_t *len)
     return classSpecificInterfaceDescriptorDFU;
 }
 
+unsigned camera_frame_binning(uint8_t frame_index)
+{
+    if (frame_index == 0 || frame_index > CAMERA_UVC_NUM_FRAMES)
+        return 0;
+    return frame_binning[frame_index - 1];
+}
+
+unsigned camera_format_bits(uint8_t format_index)
+{
+    if (format_index == 0 || format_index > CAMERA_UVC_NUM_FORMATS)
+        return 0;
+    return formats[format_index - 1].bits;
+}
+
+bool camera_format_compressed(uint8_t format_index)
+{
+    if (format_index == 0 || format_index > CAMERA_UVC_NUM_FORMATS)
+        return false;
+    return formats[format_index - 1].compressed;
+}
+
+/* Largest frame of the format, compressed one included */
+uint32_t camera_frame_size(uint8_t format_index, uint16_t width, uint16_t height)
+{
+    if (camera_format_compressed(format_index))
+        return UVC_RICE_FRAME_SIZE((uint32_t)width, height);
+    return UVC_FRAME_SIZE((uint32_t)width, height, camera_format_bits(format_index));
+}
+
+const struct camera_alt_setting_s *camera_get_alt_setting(uint8_t alt)
+{
+#if CAMERA_UVC_BULK
+    return NULL;
+#else
+    if (alt == 0 || alt > CAMERA_UVC_NUM_ALTS)
+        return NULL;
+    return &alt_settings[alt - 1];
+#endif
+}
+
+uint32_t camera_alt_payload_size(uint8_t alt)
+{
+#if CAMERA_UVC_BULK
+    // bulk endpoint lives in alt 0 and is not paced by microframes
+    return CAMERA_UVC_PAYLOAD_SIZE;
+#else
+    const struct camera_alt_setting_s *setting = camera_get_alt_setting(alt);
+    if (setting == NULL)
+        return 0;
+    return (uint32_t)setting->packet_size * setting->mult;
+#endif
+}
+
+/*
+ * Smallest alternate setting which delivers frame_size bytes within
+ * frame_interval (100 ns units), one payload with header per microframe
+ */
+uint8_t camera_select_alt(uint32_t frame_size, uint32_t frame_interval)
+{
+#if CAMERA_UVC_BULK
+    return 0;
+#else
+    frame_size += CAMERA_UVC_METADATA_LEN;
+    uint32_t microframes = frame_interval / UVC_MICROFRAME_INTERVAL;
+    if (microframes == 0)
+        microframes = 1;
+
+    uint8_t alt;
+    for (alt = 1; alt < CAMERA_UVC_NUM_ALTS; alt++) {
+        uint64_t capacity = (uint64_t)(camera_alt_payload_size(alt) - UVC_HEADER_LEN) * microframes;
+        if (capacity >= frame_size)
+            break;
+    }
+    return alt;
+#endif
+}
+
+/*
+ * Shortest frame interval (100 ns units) which the largest
+ * alternate setting can sustain for frame_size
+ */
+uint32_t camera_min_frame_interval(uint32_t frame_size)
+{
+#if CAMERA_UVC_BULK
+    return 0;
+#else
+    uint32_t data = camera_alt_payload_size(CAMERA_UVC_NUM_ALTS) - UVC_HEADER_LEN;
+    uint32_t microframes = (frame_size + CAMERA_UVC_METADATA_LEN + data - 1U) / data;
+    return microframes * UVC_MICROFRAME_INTERVAL;
+#endif
+}
+
 void camera_fill_probe_control(uint8_t *probe, uint16_t width, uint16_t height)
 {
+    uint8_t alt = camera_select_alt(UVC_FRAME_SIZE(width, height, UVC_BITS_PER_PIXEL), UVC_DEFAULT_FRAME_INTERVAL);
     const uint8_t probe_control[] = {
         WBVAL(0x0001U),                     // bmHint
         0x01U,                              // bFormatIndex
         0x01U,                              // bFrameIndex
-        DBVAL(UVC_INTERVAL(UVC_CAM_FPS_HS)),// dwFrameInterval
+        DBVAL(UVC_DEFAULT_FRAME_INTERVAL),  // dwFrameInterval
         WBVAL(0x0000U),                     // wKeyFrameRate
         WBVAL(0x0000U),                     // wPFrameRate
         WBVAL(0x0000U),                     // wCompQuality
         WBVAL(0x0000U),                     // wCompWindowSize
         WBVAL(0x0000U),                     // wDelay
-        DBVAL(width * height * 2),          // dwMaxVideoFrameSize
-        DBVAL(CAMERA_UVC_EPIN_SIZE),        // dwMaxPayloadTransferSize
-        DBVAL(24000000UL),                  // dwClockFrequency
+        DBVAL(UVC_FRAME_SIZE(width, height, UVC_BITS_PER_PIXEL)), // dwMaxVideoFrameSize
+        DBVAL(camera_alt_payload_size(alt)),// dwMaxPayloadTransferSize
+        DBVAL(CAMERA_UVC_CLOCK_FREQUENCY),  // dwClockFrequency
         0x00U,                              // bmFramingInfo
         0x00U,                              // bPreferedVersion
         0x00U,                              // bMinVersion
@@ -776,3 +1135,16 @@ void camera_fill_probe_control(uint8_t *probe, uint16_t width, uint16_t height)
     };
     memcpy(probe, probe_control, sizeof(probe_control));
 }
+
+void camera_fill_still_probe_control(uint8_t *probe, uint16_t width, uint16_t height)
+{
+    uint8_t alt = camera_select_alt(UVC_FRAME_SIZE(width, height, UVC_BITS_PER_PIXEL), UVC_DEFAULT_FRAME_INTERVAL);
+    const uint8_t still_probe_control[] = {
+        0x01U,                              // bFormatIndex
+        0x01U,                              // bFrameIndex
+        0x00U,                              // bCompressionIndex
+        DBVAL(UVC_FRAME_SIZE(width, height, UVC_BITS_PER_PIXEL)), // dwMaxVideoFrameSize
+        DBVAL(camera_alt_payload_size(alt)),// dwMaxPayloadTransferSize
+    };
+    memcpy(probe, still_probe_control, sizeof(still_probe_control));
+}
@@ -55,7 +55,7 @@ static struct {
     enum dfu_state_e state;
     uint8_t DFU_alt;
     uint8_t status_buf[6];
-    uint8_t data_buf[DFU_TRANSFER_SIZE];
+    __ALIGN_BEGIN uint8_t data_buf[DFU_TRANSFER_SIZE] __ALIGN_END;
 
     uint32_t address;
     uint16_t block_num;
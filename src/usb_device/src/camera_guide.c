@@ -0,0 +1,67 @@
+#include <stdbool.h>
+#include <string.h>
+#include <camera_internal.h>
+
+#include "usbd_core.h"
+#include "usbd_def.h"
+
+#include "usbd_conf.h"
+
+/*
+ * Guide interface
+ *
+ * Vendor specific interface with one interrupt IN endpoint, it carries
+ * star centroids measured in guide ROIs. Each report is one transfer,
+ * a report which comes while the previous one is not taken by host yet
+ * is dropped: host needs the latest stars only.
+ */
+
+#define GUIDE_REPORT_MAX_LEN (8U + 16U * CAMERA_GUIDE_MAX_ROIS)
+
+static struct {
+    __ALIGN_BEGIN uint8_t txbuf[GUIDE_REPORT_MAX_LEN] __ALIGN_END;
+    bool busy;
+} guide_state;
+
+uint8_t GUIDE_Init(struct _USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    USBD_StatusTypeDef status;
+
+    status = USBD_LL_OpenEP(pdev, CAMERA_GUIDE_EPIN, USBD_EP_TYPE_INTR, CAMERA_GUIDE_EPIN_SIZE);
+    if (status != USBD_OK)
+        return status;
+
+    pdev->ep_in[CAMERA_GUIDE_EPIN & 0x0FU].is_used = 1U;
+    pdev->ep_in[CAMERA_GUIDE_EPIN & 0x0FU].maxpacket = CAMERA_GUIDE_EPIN_SIZE;
+    guide_state.busy = false;
+
+    UNUSED(cfgidx);
+    return USBD_OK;
+}
+
+void GUIDE_DeInit(struct _USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    USBD_LL_CloseEP(pdev, CAMERA_GUIDE_EPIN);
+    pdev->ep_in[CAMERA_GUIDE_EPIN & 0xFU].is_used = 0U;
+
+    UNUSED(cfgidx);
+}
+
+uint8_t USBD_CAMERA_GUIDE_SendReport(USBD_HandleTypeDef *pdev, const uint8_t *data, size_t len)
+{
+    if (pdev->dev_state != USBD_STATE_CONFIGURED)
+        return USBD_FAIL;
+    if (len > GUIDE_REPORT_MAX_LEN)
+        return USBD_FAIL;
+    if (guide_state.busy)
+        return USBD_BUSY;
+    guide_state.busy = true;
+    memcpy(guide_state.txbuf, data, len);
+    return USBD_LL_Transmit(pdev, CAMERA_GUIDE_EPIN, guide_state.txbuf, len);
+}
+
+uint8_t GUIDE_DataIn(struct _USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    guide_state.busy = false;
+    return USBD_OK;
+}
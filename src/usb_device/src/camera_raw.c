@@ -0,0 +1,288 @@
+#include <stdbool.h>
+#include <string.h>
+#include <camera_internal.h>
+
+#include "usbd_core.h"
+#include "usbd_def.h"
+
+#include "usbd_conf.h"
+
+/*
+ * Raw frame interface
+ *
+ * Vendor specific interface with one bulk IN endpoint for capture software
+ * which talks to the camera by libusb. Host starts and stops frames with
+ * vendor requests on the interface, CLEAR_FEATURE(ENDPOINT_HALT) on the
+ * endpoint stops them too.
+ *
+ * Each frame is one transfer: CAMERA_RAW_HEADER_LEN bytes of header from
+ * application (one full packet), then frame data as it is stored in SRAM,
+ * ended by a short packet or ZLP. Frame data is sent by OTG DMA straight
+ * from memory-mapped SRAM in CAMERA_RAW_BLOCK pieces, SRAM is mapped only
+ * while a piece is sent so other reads get it in between. A busy QSPI is
+ * tried again on next SOF, as is a frame which is not queued yet.
+ *
+ * Resend request asks for a byte range of a frame still in SRAM, by its
+ * sequence. The range goes as the next transfer, with RAW_FRAME_RESENT
+ * in the header, also when frames are not started.
+ *
+ * Interface is built with OTG DMA only (CAMERA_RAW_ENABLE), without it
+ * frame data would be copied through FIFO by CPU in USB interrupt.
+ */
+
+#if CAMERA_RAW_ENABLE
+
+#define RAW_REQ_START   0x01U
+#define RAW_REQ_STOP    0x02U
+#define RAW_REQ_RESEND  0x03U   // data: sequence, offset, length, u32 little endian
+
+#define RAW_RESEND_LEN  12U
+
+enum raw_state_e {
+    RAW_IDLE = 0,       // waiting for a frame
+    RAW_HEADER,
+    RAW_DATA_WAIT,      // waiting for mapped SRAM
+    RAW_DATA,
+    RAW_ZLP,
+};
+
+static struct {
+    __ALIGN_BEGIN uint8_t header[CAMERA_RAW_HEADER_LEN] __ALIGN_END;
+    bool streaming;
+    bool mapped;
+    enum raw_state_e state;
+    const uint8_t *data;    // frame data in memory-mapped SRAM
+    uint32_t size;
+    uint32_t offset;        // data bytes given to endpoint
+
+    __ALIGN_BEGIN uint8_t req_buf[USBD_DMA_ALIGN(RAW_RESEND_LEN)] __ALIGN_END;
+    bool resend_pending;
+    uint32_t resend_sequence;
+    uint32_t resend_offset;
+    uint32_t resend_length;
+} raw_state;
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static struct USBD_CAMERA_callbacks_t *raw_callbacks(struct _USBD_HandleTypeDef *pdev)
+{
+    return (struct USBD_CAMERA_callbacks_t *)(pdev->pUserData[USBD_CAMERA_handle.classId]);
+}
+
+static void raw_unmap(struct _USBD_HandleTypeDef *pdev)
+{
+    struct USBD_CAMERA_callbacks_t *cbs = raw_callbacks(pdev);
+    if (!raw_state.mapped || cbs == NULL)
+        return;
+    cbs->VS_SetMapped(false);
+    raw_state.mapped = false;
+}
+
+static void raw_next_frame(struct _USBD_HandleTypeDef *pdev)
+{
+    struct USBD_CAMERA_callbacks_t *cbs = raw_callbacks(pdev);
+    if (raw_state.state != RAW_IDLE || cbs == NULL)
+        return;
+
+    memset(raw_state.header, 0, sizeof(raw_state.header));
+    if (raw_state.resend_pending && cbs->RAW_ResendFrame != NULL) {
+        // resend goes before queued frames
+        if (cbs->RAW_ResendFrame(raw_state.header, raw_state.resend_sequence, raw_state.resend_offset,
+                                 raw_state.resend_length, &raw_state.data, &raw_state.size) != USBD_OK)
+            return;
+        raw_state.resend_pending = false;
+    } else {
+        if (!raw_state.streaming || cbs->RAW_NextFrame == NULL)
+            return;
+        if (cbs->RAW_NextFrame(raw_state.header, &raw_state.data, &raw_state.size) != USBD_OK)
+            return;
+    }
+    raw_state.offset = 0;
+    raw_state.state = RAW_HEADER;
+    USBD_LL_Transmit(pdev, CAMERA_RAW_EPIN, raw_state.header, CAMERA_RAW_HEADER_LEN);
+}
+
+static void raw_send_data(struct _USBD_HandleTypeDef *pdev)
+{
+    struct USBD_CAMERA_callbacks_t *cbs = raw_callbacks(pdev);
+    if (raw_state.state != RAW_DATA_WAIT)
+        return;
+    if (!raw_state.mapped) {
+        // another read is running, retry on next SOF
+        if (cbs->VS_SetMapped(true) != USBD_OK)
+            return;
+        raw_state.mapped = true;
+    }
+
+    // blocks are whole packets, only the end of frame is short
+    uint32_t len = MIN(CAMERA_RAW_BLOCK, raw_state.size - raw_state.offset);
+    const uint8_t *buf = raw_state.data + raw_state.offset;
+    raw_state.offset += len;
+    raw_state.state = RAW_DATA;
+    USBD_LL_Transmit(pdev, CAMERA_RAW_EPIN, (uint8_t *)buf, len);
+}
+
+static void raw_frame_done(struct _USBD_HandleTypeDef *pdev)
+{
+    struct USBD_CAMERA_callbacks_t *cbs = raw_callbacks(pdev);
+    raw_state.state = RAW_IDLE;
+    if (cbs != NULL && cbs->RAW_FrameDone != NULL)
+        cbs->RAW_FrameDone();
+}
+
+static void raw_stop(struct _USBD_HandleTypeDef *pdev)
+{
+    struct USBD_CAMERA_callbacks_t *cbs = raw_callbacks(pdev);
+    bool streaming = raw_state.streaming;
+
+    raw_state.streaming = false;
+    raw_state.resend_pending = false;
+    if (raw_state.state != RAW_IDLE) {
+        USBD_LL_FlushEP(pdev, CAMERA_RAW_EPIN);
+        raw_unmap(pdev);
+        // frame which is cut is given back
+        raw_frame_done(pdev);
+    }
+    if (streaming && cbs != NULL && cbs->RAW_StopStream != NULL)
+        cbs->RAW_StopStream();
+}
+
+static uint8_t raw_start(struct _USBD_HandleTypeDef *pdev)
+{
+    struct USBD_CAMERA_callbacks_t *cbs = raw_callbacks(pdev);
+    if (cbs == NULL || cbs->RAW_NextFrame == NULL || cbs->VS_SetMapped == NULL)
+        return USBD_FAIL;
+
+    // host restarts after an error, next transfer begins with a header
+    raw_stop(pdev);
+    raw_state.streaming = true;
+    if (cbs->RAW_StartStream != NULL && cbs->RAW_StartStream() != USBD_OK) {
+        raw_state.streaming = false;
+        return USBD_FAIL;
+    }
+    raw_next_frame(pdev);
+    return USBD_OK;
+}
+
+uint8_t RAW_Init(struct _USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    USBD_StatusTypeDef status;
+
+    status = USBD_LL_OpenEP(pdev, CAMERA_RAW_EPIN, USBD_EP_TYPE_BULK, CAMERA_RAW_EPIN_SIZE);
+    if (status != USBD_OK)
+        return status;
+
+    pdev->ep_in[CAMERA_RAW_EPIN & 0x0FU].is_used = 1U;
+    pdev->ep_in[CAMERA_RAW_EPIN & 0x0FU].maxpacket = CAMERA_RAW_EPIN_SIZE;
+    raw_stop(pdev);
+
+    UNUSED(cfgidx);
+    return USBD_OK;
+}
+
+void RAW_DeInit(struct _USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    raw_stop(pdev);
+    USBD_LL_CloseEP(pdev, CAMERA_RAW_EPIN);
+    pdev->ep_in[CAMERA_RAW_EPIN & 0xFU].is_used = 0U;
+
+    UNUSED(cfgidx);
+}
+
+void RAW_Setup(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+    switch (req->bmRequest & USB_REQ_TYPE_MASK)
+    {
+    case USB_REQ_TYPE_VENDOR:
+        if ((req->bmRequest & USB_REQ_RECIPIENT_MASK) != USB_REQ_RECIPIENT_INTERFACE) {
+            USBD_CtlError(pdev, req);
+            return;
+        }
+        switch (req->bRequest)
+        {
+        case RAW_REQ_START:
+            if (raw_start(pdev) != USBD_OK) {
+                USBD_CtlError(pdev, req);
+                return;
+            }
+            USBD_CtlSendStatus(pdev);
+            break;
+        case RAW_REQ_STOP:
+            raw_stop(pdev);
+            USBD_CtlSendStatus(pdev);
+            break;
+        case RAW_REQ_RESEND:
+            if (req->wLength != RAW_RESEND_LEN || raw_state.resend_pending) {
+                USBD_CtlError(pdev, req);
+                return;
+            }
+            USBD_CAMERA_ExpectRx(CAMERA_RAW_INTERFACE_ID);
+            USBD_CtlPrepareRx(pdev, raw_state.req_buf, RAW_RESEND_LEN);
+            break;
+        default:
+            USBD_CtlError(pdev, req);
+            break;
+        }
+        break;
+    case USB_REQ_TYPE_STANDARD:
+        // status stage of CLEAR_FEATURE is already sent by core
+        if (req->bRequest == USB_REQ_CLEAR_FEATURE &&
+            (req->bmRequest & USB_REQ_RECIPIENT_MASK) == USB_REQ_RECIPIENT_ENDPOINT &&
+            req->wValue == USB_FEATURE_EP_HALT)
+            raw_stop(pdev);
+        break;
+    default:
+        break;
+    }
+}
+
+uint8_t RAW_EP0_RxReady(struct _USBD_HandleTypeDef *pdev)
+{
+    raw_state.resend_sequence = get_u32(&raw_state.req_buf[0]);
+    raw_state.resend_offset = get_u32(&raw_state.req_buf[4]);
+    raw_state.resend_length = get_u32(&raw_state.req_buf[8]);
+    raw_state.resend_pending = true;
+    raw_next_frame(pdev);
+    return USBD_OK;
+}
+
+uint8_t RAW_DataIn(struct _USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    switch (raw_state.state)
+    {
+    case RAW_HEADER:
+    case RAW_DATA:
+        raw_unmap(pdev);
+        if (raw_state.offset < raw_state.size) {
+            raw_state.state = RAW_DATA_WAIT;
+            raw_send_data(pdev);
+        } else if ((CAMERA_RAW_HEADER_LEN + raw_state.size) % CAMERA_RAW_EPIN_SIZE == 0) {
+            // host detects end of frame only by short packet
+            raw_state.state = RAW_ZLP;
+            USBD_LL_Transmit(pdev, CAMERA_RAW_EPIN, NULL, 0);
+        } else {
+            raw_frame_done(pdev);
+            raw_next_frame(pdev);
+        }
+        break;
+    case RAW_ZLP:
+        raw_frame_done(pdev);
+        raw_next_frame(pdev);
+        break;
+    default:
+        break;
+    }
+    return USBD_OK;
+}
+
+uint8_t RAW_SOF(struct _USBD_HandleTypeDef *pdev)
+{
+    raw_send_data(pdev);
+    raw_next_frame(pdev);
+    return USBD_OK;
+}
+
+#endif
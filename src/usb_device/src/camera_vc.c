@@ -21,6 +21,18 @@
 #define XU_CURRENT_TEMPERATURE  0x05U
 #define XU_WINDOW_TEMPERATURE   0x06U
 #define XU_TRIGGER_MODE         0x07U
+#define XU_EXPOSURE             0x08U   // exposure time, us
+#define XU_TRIGGER_LATENCY      0x09U   // trigger to shutter ns: last, min, max, number of triggers
+#define XU_FRAME_STATS          0x0AU   // last streamed frame: sequence, pixels, min, max, mean, saturated
+#define XU_FRAME_HISTOGRAM      0x0BU   // last streamed frame: CAMERA_STATS_BINS counters
+#define XU_AE_TARGET            0x0CU   // auto exposure target ADU and its percentile
+#define XU_GUIDE_ROI            0x0DU   // count, size, then x, y of each ROI centre
+#define XU_STACK                0x0EU   // depth, flags and output shift of frame stacking
+
+#define XU_GUIDE_ROI_LEN        (2U + 4U * CAMERA_GUIDE_MAX_ROIS)
+
+#define MAX_EXPOSURE    (10000U*3600U*24U)  // 24 hours in 100 us
+#define MAX_EXPOSURE_US 0xFFFFFFFFU         // about 71 minutes, longer is set by absolute exposure
 
 #define MAX_EXPECTED_TEMPERATURE 10000U // 1000 K in 0.1K
 #define MAX_TM 0x03
@@ -30,7 +42,7 @@
 
 struct {
     bool expect_buf;
-    uint8_t set_cur_buf[4];
+    __ALIGN_BEGIN uint8_t set_cur_buf[USBD_DMA_ALIGN(XU_GUIDE_ROI_LEN)] __ALIGN_END;
     size_t  set_cur_buf_len;
     uint8_t set_cur_entity;
     uint8_t set_cur_selector;
@@ -84,13 +96,17 @@ static void VC_Req_GET_DEF(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
 {
     uint8_t entity = HIBYTE(req->wIndex);
     uint8_t cs = HIBYTE(req->wValue);
-    uint8_t buf[4];
+    uint8_t buf[XU_GUIDE_ROI_LEN];
     size_t len = 0;
     switch (entity) {
     case 0x01U: // Input terminal
         {
             const uint32_t exposure = VC_DEFAULT_EXPOSURE; // 0.1 sec
             switch (cs) {
+            case 0x02:  // Auto exposure mode
+                buf[0] = VC_AE_MODE_MANUAL;
+                len = 1;
+                break;
             case 0x04:  // Absolute time
                 buf[0] = exposure & 0xFFU;
                 buf[1] = (exposure >> 8) & 0xFFU;
@@ -148,6 +164,27 @@ static void VC_Req_GET_DEF(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
                 buf[0] = 0x00;
                 len = 1;
                 break;
+            case XU_EXPOSURE:     // EXPOSURE
+                buf[0] = (VC_DEFAULT_EXPOSURE * 100U) & 0xFFU;
+                buf[1] = ((VC_DEFAULT_EXPOSURE * 100U) >> 8) & 0xFFU;
+                buf[2] = ((VC_DEFAULT_EXPOSURE * 100U) >> 16) & 0xFFU;
+                buf[3] = ((VC_DEFAULT_EXPOSURE * 100U) >> 24) & 0xFFU;
+                len = 4;
+                break;
+            case XU_AE_TARGET:     // AE TARGET
+                buf[0] = LOBYTE(VC_DEFAULT_AE_TARGET);
+                buf[1] = HIBYTE(VC_DEFAULT_AE_TARGET);
+                buf[2] = VC_DEFAULT_AE_PERCENTILE;
+                len = 3;
+                break;
+            case XU_GUIDE_ROI:     // GUIDE ROI
+                memset(buf, 0, XU_GUIDE_ROI_LEN);
+                len = XU_GUIDE_ROI_LEN;
+                break;
+            case XU_STACK:     // STACK
+                memset(buf, 0, 4);
+                len = 4;
+                break;
             }
         }
         break;
@@ -164,7 +201,7 @@ static void VC_Req_GET_MIN(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
 {
     uint8_t entity = HIBYTE(req->wIndex);
     uint8_t cs = HIBYTE(req->wValue);
-    uint8_t buf[4];
+    uint8_t buf[XU_GUIDE_ROI_LEN];
     size_t len = 0;
     switch (entity) {
     case 0x01U: // Input terminal
@@ -227,6 +264,27 @@ static void VC_Req_GET_MIN(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
                 buf[0] = 0x00;
                 len = 1;
                 break;
+            case XU_EXPOSURE:     // EXPOSURE
+                buf[0] = 0x01U;
+                buf[1] = 0x00U;
+                buf[2] = 0x00U;
+                buf[3] = 0x00U;
+                len = 4;
+                break;
+            case XU_AE_TARGET:     // AE TARGET
+                buf[0] = 0x00U;
+                buf[1] = 0x00U;
+                buf[2] = 0x00U;
+                len = 3;
+                break;
+            case XU_GUIDE_ROI:     // GUIDE ROI
+                memset(buf, 0, XU_GUIDE_ROI_LEN);
+                len = XU_GUIDE_ROI_LEN;
+                break;
+            case XU_STACK:     // STACK
+                memset(buf, 0, 4);
+                len = 4;
+                break;
             }
         }
         break;
@@ -243,12 +301,12 @@ static void VC_Req_GET_MAX(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
 {
     uint8_t entity = HIBYTE(req->wIndex);
     uint8_t cs = HIBYTE(req->wValue);
-    uint8_t buf[4];
+    uint8_t buf[XU_GUIDE_ROI_LEN];
     size_t len = 0;
     switch (entity) {
     case 0x01U: // Input terminal
         {
-            const uint32_t max_exposure = 10000*3600; // 1 hour
+            const uint32_t max_exposure = MAX_EXPOSURE;
             switch (cs) {
             case 0x04:  // Absolute time
                 buf[0] = max_exposure & 0xFFU;
@@ -307,6 +365,32 @@ static void VC_Req_GET_MAX(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
                 buf[0] = MAX_TM;
                 len = 1;
                 break;
+            case XU_EXPOSURE:     // EXPOSURE
+                buf[0] = MAX_EXPOSURE_US & 0xFFU;
+                buf[1] = (MAX_EXPOSURE_US >> 8) & 0xFFU;
+                buf[2] = (MAX_EXPOSURE_US >> 16) & 0xFFU;
+                buf[3] = (MAX_EXPOSURE_US >> 24) & 0xFFU;
+                len = 4;
+                break;
+            case XU_AE_TARGET:     // AE TARGET
+                buf[0] = 0xFFU;
+                buf[1] = 0xFFU;
+                buf[2] = 100U;
+                len = 3;
+                break;
+            case XU_GUIDE_ROI:     // GUIDE ROI
+                memset(buf, 0xFF, XU_GUIDE_ROI_LEN);
+                buf[0] = CAMERA_GUIDE_MAX_ROIS;
+                buf[1] = CAMERA_GUIDE_MAX_ROI_SIZE;
+                len = XU_GUIDE_ROI_LEN;
+                break;
+            case XU_STACK:     // STACK
+                buf[0] = 0xFFU;
+                buf[1] = 0xFFU;
+                buf[2] = VC_STACK_REJECT_MINMAX;
+                buf[3] = VC_STACK_MAX_SHIFT;
+                len = 4;
+                break;
             }
         }
         break;
@@ -323,12 +407,16 @@ static void VC_Req_GET_RES(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
 {
     uint8_t entity = HIBYTE(req->wIndex);
     uint8_t cs = HIBYTE(req->wValue);
-    uint8_t buf[4];
+    uint8_t buf[XU_GUIDE_ROI_LEN];
     size_t len = 0;
     switch (entity) {
     case 0x01U: // Input terminal
         {
             switch (cs) {
+            case 0x02:  // Auto exposure mode
+                buf[0] = VC_AE_MODE_MANUAL | VC_AE_MODE_AUTO | VC_AE_MODE_APERTURE_PRIORITY;
+                len = 1;
+                break;
             case 0x04:  // Absolute time
                 buf[0] = 0x01;
                 buf[1] = 0x00;
@@ -386,6 +474,37 @@ static void VC_Req_GET_RES(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
                 buf[0] = 0x01;
                 len = 1;
                 break;
+            case XU_EXPOSURE:     // EXPOSURE
+                buf[0] = 0x01U;
+                buf[1] = 0x00U;
+                buf[2] = 0x00U;
+                buf[3] = 0x00U;
+                len = 4;
+                break;
+            case XU_AE_TARGET:     // AE TARGET
+                buf[0] = 0x01U;
+                buf[1] = 0x00U;
+                buf[2] = 0x01U;
+                len = 3;
+                break;
+            case XU_GUIDE_ROI:     // GUIDE ROI
+                {
+                    unsigned i;
+                    memset(buf, 0, XU_GUIDE_ROI_LEN);
+                    buf[0] = 0x01U;
+                    buf[1] = 0x02U;     // ROI side is even
+                    for (i = 0; i < CAMERA_GUIDE_MAX_ROIS * 2U; i++)
+                        buf[2 + i*2] = 0x01U;
+                }
+                len = XU_GUIDE_ROI_LEN;
+                break;
+            case XU_STACK:     // STACK
+                buf[0] = 0x01U;
+                buf[1] = 0x00U;
+                buf[2] = 0x01U;
+                buf[3] = 0x01U;
+                len = 4;
+                break;
             }
         }
         break;
@@ -409,6 +528,10 @@ static void VC_Req_GET_LEN(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
     case 0x01U: // Input terminal
         {
             switch (cs) {
+            case 0x02:  // Auto exposure mode
+                ctl_len = 1;
+                len = 2;
+                break;
             case 0x04:  // Absolute time
                 ctl_len = 4;
                 len = 2;
@@ -459,6 +582,34 @@ static void VC_Req_GET_LEN(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
                 ctl_len = 1;
                 len = 2;
                 break;
+            case XU_EXPOSURE:     // EXPOSURE
+                ctl_len = 4;
+                len = 2;
+                break;
+            case XU_TRIGGER_LATENCY:     // TRIGGER LATENCY
+                ctl_len = 16;
+                len = 2;
+                break;
+            case XU_FRAME_STATS:     // FRAME STATS
+                ctl_len = 24;
+                len = 2;
+                break;
+            case XU_FRAME_HISTOGRAM:     // FRAME HISTOGRAM
+                ctl_len = CAMERA_STATS_BINS * 4U;
+                len = 2;
+                break;
+            case XU_AE_TARGET:     // AE TARGET
+                ctl_len = 3;
+                len = 2;
+                break;
+            case XU_GUIDE_ROI:     // GUIDE ROI
+                ctl_len = XU_GUIDE_ROI_LEN;
+                len = 2;
+                break;
+            case XU_STACK:     // STACK
+                ctl_len = 4;
+                len = 2;
+                break;
             }
         }
         break;
@@ -484,9 +635,12 @@ static void VC_Req_GET_INFO(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTyped
     case 0x01U: // Input terminal
         {
             switch (cs) {
-            case 0x04:  // Absolute exposure time
+            case 0x02:  // Auto exposure mode
                 caps = 0x03U;
                 break;
+            case 0x04:  // Absolute exposure time
+                caps = 0x0BU;   // autoupdate, auto exposure changes it
+                break;
             }
         }
         break;
@@ -494,7 +648,7 @@ static void VC_Req_GET_INFO(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTyped
         {
             switch (cs) {
             case 0x04:  // Gain
-                caps = 0x03U;
+                caps = 0x0BU;
                 break;
             }
         }
@@ -525,6 +679,27 @@ static void VC_Req_GET_INFO(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTyped
             case XU_TRIGGER_MODE:     // TRIGGER MODE
                 caps = 0x03U;
                 break;
+            case XU_EXPOSURE:     // EXPOSURE
+                caps = 0x0BU;
+                break;
+            case XU_TRIGGER_LATENCY:     // TRIGGER LATENCY
+                caps = 0x01U;
+                break;
+            case XU_FRAME_STATS:     // FRAME STATS
+                caps = 0x01U;
+                break;
+            case XU_FRAME_HISTOGRAM:     // FRAME HISTOGRAM
+                caps = 0x01U;
+                break;
+            case XU_AE_TARGET:     // AE TARGET
+                caps = 0x03U;
+                break;
+            case XU_GUIDE_ROI:     // GUIDE ROI
+                caps = 0x03U;
+                break;
+            case XU_STACK:     // STACK
+                caps = 0x03U;
+                break;
             }
         }
         break;
@@ -539,12 +714,23 @@ static void VC_Req_GET_CUR(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
 
     uint8_t entity = HIBYTE(req->wIndex);
     uint8_t cs = HIBYTE(req->wValue);
-    uint8_t buf[4] = {0};
+    uint8_t buf[24] = {0};
+    uint8_t *pbuf = buf;
     size_t len = 0;
     switch (entity) {
     case 0x01U: // Input terminal
         {
             switch (cs) {
+            case 0x02:  // Auto exposure mode
+                if (cbs != NULL && cbs->VC_GetAEMode != NULL) {
+                    unsigned mode;
+                    cbs->VC_GetAEMode(&mode);
+                    buf[0] = mode;
+                } else {
+                    buf[0] = VC_AE_MODE_MANUAL;
+                }
+                len = 1;
+                break;
             case 0x04:  // Absolute exposure time
                 if (cbs != NULL && cbs->VC_GetExposure != NULL) {
                     uint32_t time;
@@ -663,13 +849,119 @@ static void VC_Req_GET_CUR(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
                 }
                 len = 1;
                 break;
+            case XU_EXPOSURE:     // EXPOSURE
+                if (cbs != NULL && cbs->VC_GetExposureUs != NULL) {
+                    uint32_t time;
+                    cbs->VC_GetExposureUs(&time);
+                    buf[0] = time & 0xFFU;
+                    buf[1] = (time >> 8) & 0xFFU;
+                    buf[2] = (time >> 16) & 0xFFU;
+                    buf[3] = (time >> 24) & 0xFFU;
+                } else {
+                    buf[0] = (VC_DEFAULT_EXPOSURE * 100U) & 0xFFU;
+                    buf[1] = ((VC_DEFAULT_EXPOSURE * 100U) >> 8) & 0xFFU;
+                    buf[2] = ((VC_DEFAULT_EXPOSURE * 100U) >> 16) & 0xFFU;
+                    buf[3] = ((VC_DEFAULT_EXPOSURE * 100U) >> 24) & 0xFFU;
+                }
+                len = 4;
+                break;
+            case XU_TRIGGER_LATENCY:     // TRIGGER LATENCY
+                {
+                    uint32_t latency[4] = {0};
+                    unsigned i;
+                    if (cbs != NULL && cbs->VC_GetTriggerLatency != NULL)
+                        cbs->VC_GetTriggerLatency(latency);
+                    for (i = 0; i < 4; i++) {
+                        buf[i*4] = latency[i] & 0xFFU;
+                        buf[i*4 + 1] = (latency[i] >> 8) & 0xFFU;
+                        buf[i*4 + 2] = (latency[i] >> 16) & 0xFFU;
+                        buf[i*4 + 3] = (latency[i] >> 24) & 0xFFU;
+                    }
+                }
+                len = 16;
+                break;
+            case XU_FRAME_STATS:     // FRAME STATS
+                {
+                    uint32_t stats[6] = {0};
+                    unsigned i;
+                    if (cbs != NULL && cbs->VC_GetFrameStats != NULL)
+                        cbs->VC_GetFrameStats(stats);
+                    for (i = 0; i < 6; i++) {
+                        buf[i*4] = stats[i] & 0xFFU;
+                        buf[i*4 + 1] = (stats[i] >> 8) & 0xFFU;
+                        buf[i*4 + 2] = (stats[i] >> 16) & 0xFFU;
+                        buf[i*4 + 3] = (stats[i] >> 24) & 0xFFU;
+                    }
+                }
+                len = 24;
+                break;
+            case XU_FRAME_HISTOGRAM:     // FRAME HISTOGRAM
+                {
+                    // more than one EP0 packet, buffer must outlive the request
+                    static uint32_t histogram[CAMERA_STATS_BINS];
+                    static uint8_t histogram_buf[CAMERA_STATS_BINS * 4U];
+                    unsigned i;
+                    memset(histogram, 0, sizeof(histogram));
+                    if (cbs != NULL && cbs->VC_GetFrameHistogram != NULL)
+                        cbs->VC_GetFrameHistogram(histogram);
+                    for (i = 0; i < CAMERA_STATS_BINS; i++) {
+                        histogram_buf[i*4] = histogram[i] & 0xFFU;
+                        histogram_buf[i*4 + 1] = (histogram[i] >> 8) & 0xFFU;
+                        histogram_buf[i*4 + 2] = (histogram[i] >> 16) & 0xFFU;
+                        histogram_buf[i*4 + 3] = (histogram[i] >> 24) & 0xFFU;
+                    }
+                    pbuf = histogram_buf;
+                }
+                len = CAMERA_STATS_BINS * 4U;
+                break;
+            case XU_AE_TARGET:     // AE TARGET
+                {
+                    unsigned target = VC_DEFAULT_AE_TARGET;
+                    unsigned percentile = VC_DEFAULT_AE_PERCENTILE;
+                    if (cbs != NULL && cbs->VC_GetAETarget != NULL)
+                        cbs->VC_GetAETarget(&target, &percentile);
+                    buf[0] = LOBYTE(target);
+                    buf[1] = HIBYTE(target);
+                    buf[2] = percentile;
+                }
+                len = 3;
+                break;
+            case XU_GUIDE_ROI:     // GUIDE ROI
+                {
+                    unsigned count = 0, size = 0, i;
+                    uint16_t centers[CAMERA_GUIDE_MAX_ROIS][2] = {0};
+                    if (cbs != NULL && cbs->VC_GetGuideROIs != NULL)
+                        cbs->VC_GetGuideROIs(&count, &size, centers);
+                    buf[0] = count;
+                    buf[1] = size;
+                    for (i = 0; i < CAMERA_GUIDE_MAX_ROIS; i++) {
+                        buf[2 + i*4] = LOBYTE(centers[i][0]);
+                        buf[2 + i*4 + 1] = HIBYTE(centers[i][0]);
+                        buf[2 + i*4 + 2] = LOBYTE(centers[i][1]);
+                        buf[2 + i*4 + 3] = HIBYTE(centers[i][1]);
+                    }
+                }
+                len = XU_GUIDE_ROI_LEN;
+                break;
+            case XU_STACK:     // STACK
+                {
+                    unsigned depth = 0, flags = 0, shift = 0;
+                    if (cbs != NULL && cbs->VC_GetStack != NULL)
+                        cbs->VC_GetStack(&depth, &flags, &shift);
+                    buf[0] = LOBYTE(depth);
+                    buf[1] = HIBYTE(depth);
+                    buf[2] = flags;
+                    buf[3] = shift;
+                }
+                len = 4;
+                break;
             }
         }
         break;
     }
     if (len > 0) {
         USBD_CAMERA_handle.ep0tx_iface = CAMERA_VC_INTERFACE_ID;
-        USBD_CtlSendData(pdev, buf, len);
+        USBD_CtlSendData(pdev, pbuf, MIN(len, req->wLength));
     } else {
         USBD_CtlError(pdev, req);
     }
@@ -683,6 +975,14 @@ static void VC_Req_SET_CUR(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
     case 0x01U: // Input terminal
         {
             switch (cs) {
+            case 0x02:  // auto exposure mode
+                vc_state.expect_buf = true;
+                vc_state.set_cur_buf_len = 1;
+                vc_state.set_cur_entity = 0x01U;
+                vc_state.set_cur_selector = 0x02U;  // auto exposure mode
+                USBD_CAMERA_ExpectRx(CAMERA_VC_INTERFACE_ID);
+                USBD_CtlPrepareRx(pdev, vc_state.set_cur_buf, 1);
+                break;
             case 0x04:  // absolute time
                 vc_state.expect_buf = true;
                 vc_state.set_cur_buf_len = 4;
@@ -738,6 +1038,38 @@ static void VC_Req_SET_CUR(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypede
                 USBD_CAMERA_ExpectRx(CAMERA_VC_INTERFACE_ID);
                 USBD_CtlPrepareRx(pdev, vc_state.set_cur_buf, 2);
                 break;
+            case XU_AE_TARGET:
+                vc_state.expect_buf = true;
+                vc_state.set_cur_buf_len = 3;
+                vc_state.set_cur_entity = 0x04U;
+                vc_state.set_cur_selector = cs;
+                USBD_CAMERA_ExpectRx(CAMERA_VC_INTERFACE_ID);
+                USBD_CtlPrepareRx(pdev, vc_state.set_cur_buf, 3);
+                break;
+            case XU_GUIDE_ROI:
+                vc_state.expect_buf = true;
+                vc_state.set_cur_buf_len = XU_GUIDE_ROI_LEN;
+                vc_state.set_cur_entity = 0x04U;
+                vc_state.set_cur_selector = cs;
+                USBD_CAMERA_ExpectRx(CAMERA_VC_INTERFACE_ID);
+                USBD_CtlPrepareRx(pdev, vc_state.set_cur_buf, XU_GUIDE_ROI_LEN);
+                break;
+            case XU_STACK:
+                vc_state.expect_buf = true;
+                vc_state.set_cur_buf_len = 4;
+                vc_state.set_cur_entity = 0x04U;
+                vc_state.set_cur_selector = cs;
+                USBD_CAMERA_ExpectRx(CAMERA_VC_INTERFACE_ID);
+                USBD_CtlPrepareRx(pdev, vc_state.set_cur_buf, 4);
+                break;
+            case XU_EXPOSURE:
+                vc_state.expect_buf = true;
+                vc_state.set_cur_buf_len = 4;
+                vc_state.set_cur_entity = 0x04U;
+                vc_state.set_cur_selector = cs;
+                USBD_CAMERA_ExpectRx(CAMERA_VC_INTERFACE_ID);
+                USBD_CtlPrepareRx(pdev, vc_state.set_cur_buf, 4);
+                break;
             default:
                 USBD_LL_StallEP(pdev, 0x80U);
                 break;
@@ -758,6 +1090,14 @@ uint8_t VC_EP0_RxReady(struct _USBD_HandleTypeDef *pdev)
         case 0x01U: // Camera terminal
             switch (vc_state.set_cur_selector)
             {
+                case 0x02U:  // Auto exposure mode
+                    {
+                        unsigned mode = vc_state.set_cur_buf[0];
+                        if (cbs != NULL && cbs->VC_SetAEMode != NULL) {
+                            cbs->VC_SetAEMode(mode);
+                        }
+                    }
+                    break;
                 case 0x04U:  // Exposure
                     {
                         uint32_t gain = vc_state.set_cur_buf[3];
@@ -831,6 +1171,55 @@ uint8_t VC_EP0_RxReady(struct _USBD_HandleTypeDef *pdev)
                         }
                     }
                     break;
+                case XU_EXPOSURE:
+                    {
+                        uint32_t time = vc_state.set_cur_buf[3];
+                        time = time << 8 | vc_state.set_cur_buf[2];
+                        time = time << 8 | vc_state.set_cur_buf[1];
+                        time = time << 8 | vc_state.set_cur_buf[0];
+                        if (cbs != NULL && cbs->VC_SetExposureUs != NULL) {
+                            cbs->VC_SetExposureUs(time);
+                        }
+                    }
+                    break;
+                case XU_GUIDE_ROI:
+                    {
+                        uint16_t centers[CAMERA_GUIDE_MAX_ROIS][2];
+                        unsigned count = vc_state.set_cur_buf[0];
+                        unsigned size = vc_state.set_cur_buf[1];
+                        unsigned i;
+                        // request carries CAMERA_GUIDE_MAX_ROIS centers at most
+                        if (count > CAMERA_GUIDE_MAX_ROIS)
+                            break;
+                        for (i = 0; i < CAMERA_GUIDE_MAX_ROIS; i++) {
+                            const uint8_t *roi = &vc_state.set_cur_buf[2 + i*4];
+                            centers[i][0] = roi[1] << 8 | roi[0];
+                            centers[i][1] = roi[3] << 8 | roi[2];
+                        }
+                        if (cbs != NULL && cbs->VC_SetGuideROIs != NULL) {
+                            cbs->VC_SetGuideROIs(count, size, centers);
+                        }
+                    }
+                    break;
+                case XU_STACK:
+                    {
+                        unsigned depth = vc_state.set_cur_buf[1];
+                        depth = depth << 8 | vc_state.set_cur_buf[0];
+                        if (cbs != NULL && cbs->VC_SetStack != NULL) {
+                            cbs->VC_SetStack(depth, vc_state.set_cur_buf[2], vc_state.set_cur_buf[3]);
+                        }
+                    }
+                    break;
+                case XU_AE_TARGET:
+                    {
+                        unsigned target = vc_state.set_cur_buf[1];
+                        target = target << 8 | vc_state.set_cur_buf[0];
+                        unsigned percentile = vc_state.set_cur_buf[2];
+                        if (cbs != NULL && cbs->VC_SetAETarget != NULL) {
+                            cbs->VC_SetAETarget(target, percentile);
+                        }
+                    }
+                    break;
             }
             break;
             
@@ -16,37 +16,304 @@
 
 #define VS_PROBE_CONTROL_SELECTOR 0x01U
 #define VS_COMMIT_CONTROL_SELECTOR 0x02U
+#define VS_STILL_PROBE_CONTROL_SELECTOR 0x03U
+#define VS_STILL_COMMIT_CONTROL_SELECTOR 0x04U
+#define VS_STILL_IMAGE_TRIGGER_CONTROL_SELECTOR 0x05U
 
-static void VS_Req_GET_CUR(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+#define UVC_PROBE_FORMAT_INDEX 2U
+#define UVC_PROBE_FRAME_INDEX 3U
+#define UVC_PROBE_FRAME_INTERVAL 4U
+#define UVC_PROBE_MAX_FRAME_SIZE 18U
+#define UVC_PROBE_MAX_PAYLOAD_SIZE 22U
+#define UVC_PROBE_CLOCK_FREQUENCY 26U
+
+#define UVC_CONTROL_LEN sizeof(video_Probe_Control)
+
+#define UVC_STILL_FORMAT_INDEX 0U
+#define UVC_STILL_FRAME_INDEX 1U
+#define UVC_STILL_COMPRESSION_INDEX 2U
+#define UVC_STILL_MAX_FRAME_SIZE 3U
+#define UVC_STILL_MAX_PAYLOAD_SIZE 7U
+
+#define UVC_STILL_CONTROL_LEN 11U
+
+#define UVC_TRIGGER_NORMAL 0x00U
+#define UVC_TRIGGER_TRANSMIT 0x01U
+#define UVC_TRIGGER_TRANSMIT_BULK 0x02U
+#define UVC_TRIGGER_ABORT 0x03U
+
+static struct {
+    uint8_t set_cur_selector;
+    __ALIGN_BEGIN uint8_t set_cur_buf[UVC_CONTROL_LEN] __ALIGN_END;
+    uint8_t get_buf[UVC_CONTROL_LEN];
+    uint8_t still_trigger;      // still image trigger control
+} vs_state;
+
+static void put_u32(uint8_t *p, uint32_t val)
+{
+    p[0] = val & 0xFFU;
+    p[1] = (val >> 8) & 0xFFU;
+    p[2] = (val >> 16) & 0xFFU;
+    p[3] = (val >> 24) & 0xFFU;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * Fix up probe/commit control to the values device can stream:
+ * frame interval is clamped to descriptor limits and to what the largest
+ * alternate setting can sustain, payload size is set to the smallest
+ * alternate setting which fits the frame within that interval
+ */
+static uint32_t VS_FrameSize(uint8_t format_index, uint8_t frame_index)
+{
+    unsigned bin = camera_frame_binning(frame_index);
+    return camera_frame_size(format_index, USBD_CAMERA_handle.width / bin, USBD_CAMERA_handle.height / bin);
+}
+
+/* Bytes per frame bandwidth is reserved for, compressed frames are expected smaller */
+static uint32_t VS_StreamSize(uint8_t format_index, uint32_t frame_size)
+{
+    if (camera_format_compressed(format_index))
+        return frame_size / UVC_RICE_EXPECTED_RATIO;
+    return frame_size;
+}
+
+static void VS_Negotiate(uint8_t *ctl)
+{
+    uint8_t format_index = ctl[UVC_PROBE_FORMAT_INDEX];
+    if (camera_format_bits(format_index) == 0)
+        format_index = 0x01U;
+
+    uint8_t frame_index = ctl[UVC_PROBE_FRAME_INDEX];
+    if (camera_frame_binning(frame_index) == 0)
+        frame_index = 0x01U;
+
+    unsigned bin = camera_frame_binning(frame_index);
+    uint32_t frame_size = VS_FrameSize(format_index, frame_index);
+    uint32_t stream_size = VS_StreamSize(format_index, frame_size);
+    uint32_t interval = get_u32(&ctl[UVC_PROBE_FRAME_INTERVAL]);
+
+    if (interval == 0)
+        interval = UVC_BINNED_INTERVAL(UVC_DEFAULT_FRAME_INTERVAL, bin);
+    interval = MAX(interval, UVC_BINNED_INTERVAL(UVC_MIN_FRAME_INTERVAL, bin));
+    interval = MIN(interval, UVC_MAX_FRAME_INTERVAL);
+    interval = MAX(interval, camera_min_frame_interval(stream_size));
+
+    uint8_t alt = camera_select_alt(stream_size, interval);
+
+    ctl[UVC_PROBE_FORMAT_INDEX] = format_index;
+    ctl[UVC_PROBE_FRAME_INDEX] = frame_index;
+    put_u32(&ctl[UVC_PROBE_FRAME_INTERVAL], interval);
+    put_u32(&ctl[UVC_PROBE_MAX_FRAME_SIZE], frame_size);
+    put_u32(&ctl[UVC_PROBE_MAX_PAYLOAD_SIZE], camera_alt_payload_size(alt));
+    put_u32(&ctl[UVC_PROBE_CLOCK_FREQUENCY], CAMERA_UVC_CLOCK_FREQUENCY);
+}
+
+/*
+ * Still frame is sent on the video endpoint (method 2) with the payload
+ * size committed for video, only format and image size are negotiated
+ */
+static void VS_NegotiateStill(uint8_t *ctl)
+{
+    uint8_t format_index = ctl[UVC_STILL_FORMAT_INDEX];
+    if (camera_format_bits(format_index) == 0)
+        format_index = 0x01U;
+
+    uint8_t frame_index = ctl[UVC_STILL_FRAME_INDEX];
+    if (camera_frame_binning(frame_index) == 0)
+        frame_index = 0x01U;
+
+    ctl[UVC_STILL_FORMAT_INDEX] = format_index;
+    ctl[UVC_STILL_FRAME_INDEX] = frame_index;
+    ctl[UVC_STILL_COMPRESSION_INDEX] = 0x00U;
+    put_u32(&ctl[UVC_STILL_MAX_FRAME_SIZE], VS_FrameSize(format_index, frame_index));
+    put_u32(&ctl[UVC_STILL_MAX_PAYLOAD_SIZE], get_u32(&video_Commit_Control[UVC_PROBE_MAX_PAYLOAD_SIZE]));
+}
+
+static void VS_FillStillProbeLimits(uint8_t request, uint8_t *ctl)
+{
+    memcpy(ctl, video_Still_Probe_Control, UVC_STILL_CONTROL_LEN);
+    switch (request)
+    {
+    case UVC_GET_MIN:
+    case UVC_GET_DEF:
+        ctl[UVC_STILL_FORMAT_INDEX] = 0x01U;
+        ctl[UVC_STILL_FRAME_INDEX] = 0x01U;
+        VS_NegotiateStill(ctl);
+        break;
+    case UVC_GET_MAX:
+        ctl[UVC_STILL_FORMAT_INDEX] = CAMERA_UVC_NUM_FORMATS;
+        ctl[UVC_STILL_FRAME_INDEX] = CAMERA_UVC_NUM_FRAMES;
+        VS_NegotiateStill(ctl);
+        break;
+    case UVC_GET_RES:
+    default:
+        memset(ctl, 0, UVC_STILL_CONTROL_LEN);
+        ctl[UVC_STILL_FORMAT_INDEX] = 0x01U;
+        ctl[UVC_STILL_FRAME_INDEX] = 0x01U;
+        break;
+    }
+}
+
+static void VS_FillProbeLimits(uint8_t request, uint8_t *ctl)
+{
+    memcpy(ctl, video_Probe_Control, UVC_CONTROL_LEN);
+    switch (request)
+    {
+    case UVC_GET_MIN:
+        put_u32(&ctl[UVC_PROBE_FRAME_INTERVAL], 1U);
+        VS_Negotiate(ctl);
+        break;
+    case UVC_GET_MAX:
+        put_u32(&ctl[UVC_PROBE_FRAME_INTERVAL], UVC_MAX_FRAME_INTERVAL);
+        VS_Negotiate(ctl);
+        break;
+    case UVC_GET_RES:
+        memset(ctl, 0, UVC_CONTROL_LEN);
+        put_u32(&ctl[UVC_PROBE_FRAME_INTERVAL], UVC_FRAME_INTERVAL_STEP);
+        break;
+    case UVC_GET_DEF:
+    default:
+        ctl[UVC_PROBE_FORMAT_INDEX] = 0x01U;
+        ctl[UVC_PROBE_FRAME_INDEX] = 0x01U;
+        put_u32(&ctl[UVC_PROBE_FRAME_INTERVAL], 0U);
+        VS_Negotiate(ctl);
+        break;
+    }
+}
+
+static void VS_Req_GET(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
 {
+    uint8_t *ctl;
+    size_t len = UVC_CONTROL_LEN;
     switch (HIBYTE(req->wValue))
     {
     case VS_PROBE_CONTROL_SELECTOR:
-        USBD_CAMERA_handle.ep0tx_iface = CAMERA_VS_INTERFACE_ID;
-        USBD_CtlSendData(pdev, video_Probe_Control, sizeof(video_Probe_Control));
+        if (req->bRequest == UVC_GET_CUR) {
+            ctl = video_Probe_Control;
+        } else {
+            VS_FillProbeLimits(req->bRequest, vs_state.get_buf);
+            ctl = vs_state.get_buf;
+        }
+        break;
+    case VS_COMMIT_CONTROL_SELECTOR:
+        if (req->bRequest != UVC_GET_CUR) {
+            USBD_LL_StallEP(pdev, 0x80U);
+            return;
+        }
+        ctl = video_Commit_Control;
+        break;
+    case VS_STILL_PROBE_CONTROL_SELECTOR:
+        if (req->bRequest == UVC_GET_CUR) {
+            ctl = video_Still_Probe_Control;
+        } else {
+            VS_FillStillProbeLimits(req->bRequest, vs_state.get_buf);
+            ctl = vs_state.get_buf;
+        }
+        len = UVC_STILL_CONTROL_LEN;
+        break;
+    case VS_STILL_COMMIT_CONTROL_SELECTOR:
+        if (req->bRequest != UVC_GET_CUR) {
+            USBD_LL_StallEP(pdev, 0x80U);
+            return;
+        }
+        ctl = video_Still_Commit_Control;
+        len = UVC_STILL_CONTROL_LEN;
+        break;
+    case VS_STILL_IMAGE_TRIGGER_CONTROL_SELECTOR:
+        if (req->bRequest != UVC_GET_CUR) {
+            USBD_LL_StallEP(pdev, 0x80U);
+            return;
+        }
+        ctl = &vs_state.still_trigger;
+        len = 1U;
         break;
+    default:
+        USBD_LL_StallEP(pdev, 0x80U);
+        return;
+    }
+
+    USBD_CAMERA_handle.ep0tx_iface = CAMERA_VS_INTERFACE_ID;
+    USBD_CtlSendData(pdev, ctl, MIN(req->wLength, len));
+}
+
+static void VS_Req_GET_LEN(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+    switch (HIBYTE(req->wValue))
+    {
+    case VS_PROBE_CONTROL_SELECTOR:
     case VS_COMMIT_CONTROL_SELECTOR:
+        vs_state.get_buf[0] = LOBYTE(UVC_CONTROL_LEN);
+        vs_state.get_buf[1] = HIBYTE(UVC_CONTROL_LEN);
         USBD_CAMERA_handle.ep0tx_iface = CAMERA_VS_INTERFACE_ID;
-        USBD_CtlSendData(pdev, video_Probe_Control, sizeof(video_Probe_Control));
+        USBD_CtlSendData(pdev, vs_state.get_buf, MIN(req->wLength, 2U));
+        break;
+    case VS_STILL_PROBE_CONTROL_SELECTOR:
+    case VS_STILL_COMMIT_CONTROL_SELECTOR:
+        vs_state.get_buf[0] = LOBYTE(UVC_STILL_CONTROL_LEN);
+        vs_state.get_buf[1] = HIBYTE(UVC_STILL_CONTROL_LEN);
+        USBD_CAMERA_handle.ep0tx_iface = CAMERA_VS_INTERFACE_ID;
+        USBD_CtlSendData(pdev, vs_state.get_buf, MIN(req->wLength, 2U));
         break;
     default:
+        USBD_LL_StallEP(pdev, 0x80U);
         break;
     }
 }
 
 static void VS_Req_GET_INFO(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
 {
-
+    switch (HIBYTE(req->wValue))
+    {
+    case VS_PROBE_CONTROL_SELECTOR:
+    case VS_COMMIT_CONTROL_SELECTOR:
+    case VS_STILL_PROBE_CONTROL_SELECTOR:
+    case VS_STILL_COMMIT_CONTROL_SELECTOR:
+    case VS_STILL_IMAGE_TRIGGER_CONTROL_SELECTOR:
+        vs_state.get_buf[0] = 0x03U; // supports GET and SET
+        USBD_CAMERA_handle.ep0tx_iface = CAMERA_VS_INTERFACE_ID;
+        USBD_CtlSendData(pdev, vs_state.get_buf, MIN(req->wLength, 1U));
+        break;
+    default:
+        USBD_LL_StallEP(pdev, 0x80U);
+        break;
+    }
 }
 
 static void VS_Req_SET_CUR(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
 {
     switch (HIBYTE(req->wValue)) {
     case VS_PROBE_CONTROL_SELECTOR:
-        USBD_CtlPrepareRx(pdev, video_Probe_Control, MIN(req->wLength, sizeof(video_Probe_Control)));
+        vs_state.set_cur_selector = HIBYTE(req->wValue);
+        USBD_CAMERA_ExpectRx(CAMERA_VS_INTERFACE_ID);
+        USBD_CtlPrepareRx(pdev, video_Probe_Control, MIN(req->wLength, UVC_CONTROL_LEN));
         break;
     case VS_COMMIT_CONTROL_SELECTOR:
-        USBD_CtlPrepareRx(pdev, video_Probe_Control, MIN(req->wLength, sizeof(video_Probe_Control)));
+        // fields not sent by older hosts are taken from probe
+        memcpy(vs_state.set_cur_buf, video_Probe_Control, UVC_CONTROL_LEN);
+        vs_state.set_cur_selector = HIBYTE(req->wValue);
+        USBD_CAMERA_ExpectRx(CAMERA_VS_INTERFACE_ID);
+        USBD_CtlPrepareRx(pdev, vs_state.set_cur_buf, MIN(req->wLength, UVC_CONTROL_LEN));
+        break;
+    case VS_STILL_PROBE_CONTROL_SELECTOR:
+        vs_state.set_cur_selector = HIBYTE(req->wValue);
+        USBD_CAMERA_ExpectRx(CAMERA_VS_INTERFACE_ID);
+        USBD_CtlPrepareRx(pdev, video_Still_Probe_Control, MIN(req->wLength, UVC_STILL_CONTROL_LEN));
+        break;
+    case VS_STILL_COMMIT_CONTROL_SELECTOR:
+        memcpy(vs_state.set_cur_buf, video_Still_Probe_Control, UVC_STILL_CONTROL_LEN);
+        vs_state.set_cur_selector = HIBYTE(req->wValue);
+        USBD_CAMERA_ExpectRx(CAMERA_VS_INTERFACE_ID);
+        USBD_CtlPrepareRx(pdev, vs_state.set_cur_buf, MIN(req->wLength, UVC_STILL_CONTROL_LEN));
+        break;
+    case VS_STILL_IMAGE_TRIGGER_CONTROL_SELECTOR:
+        vs_state.set_cur_selector = HIBYTE(req->wValue);
+        USBD_CAMERA_ExpectRx(CAMERA_VS_INTERFACE_ID);
+        USBD_CtlPrepareRx(pdev, vs_state.set_cur_buf, MIN(req->wLength, 1U));
         break;
     default:
         USBD_LL_StallEP(pdev, 0x80U);
@@ -62,13 +329,12 @@ static void VS_SetupClass(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef
     case UVC_GET_CUR:
     case UVC_GET_MIN:
     case UVC_GET_MAX:
-        VS_Req_GET_CUR(pdev, req);
-        break;
-
     case UVC_GET_RES:
+        VS_Req_GET(pdev, req);
         break;
 
     case UVC_GET_LEN:
+        VS_Req_GET_LEN(pdev, req);
         break;
 
     case UVC_GET_INFO:
@@ -98,10 +364,16 @@ void VS_GetInterface(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req
     }
 }
 
-static void open_isoc_ep(struct _USBD_HandleTypeDef *pdev)
+/*
+ * Endpoint is opened with the size of one transaction of the alternate setting.
+ * A transfer of up to packet_size * mult is split by the core into mult
+ * packets within one microframe (HAL programs DIEPTSIZ.MCNT from packet count)
+ */
+static void open_isoc_ep(struct _USBD_HandleTypeDef *pdev, uint8_t alt)
 {
-    uint8_t res = USBD_LL_OpenEP(pdev, CAMERA_UVC_EPIN, USBD_EP_TYPE_ISOC, CAMERA_UVC_EPIN_SIZE);
-    pdev->ep_in[CAMERA_UVC_EPIN & 0x0FU].maxpacket = CAMERA_UVC_EPIN_SIZE;
+    const struct camera_alt_setting_s *setting = camera_get_alt_setting(alt);
+    uint8_t res = USBD_LL_OpenEP(pdev, CAMERA_UVC_EPIN, USBD_EP_TYPE_ISOC, setting->packet_size);
+    pdev->ep_in[CAMERA_UVC_EPIN & 0x0FU].maxpacket = setting->packet_size;
     pdev->ep_in[CAMERA_UVC_EPIN & 0x0FU].is_used = 1U;
 }
 
@@ -111,71 +383,479 @@ static void close_isoc_ep(struct _USBD_HandleTypeDef *pdev)
     pdev->ep_in[CAMERA_UVC_EPIN & 0x0FU].is_used = 0U;
 }
 
-static uint8_t frame[UVC_CHUNK+12U] = {12U, 0x00U};
-static size_t offset = 0;
-static uint8_t UVC_FID = 0x00U;
-static enum {
-    UVC_FRAME_IDLE = 0,
-    UVC_FRAME_READY,
-    UVC_FRAME_RUN,
-    UVC_FRAME_NEXT,
-} status = UVC_FRAME_IDLE;
+#define UVC_HEADER_FID 0x01U
+#define UVC_HEADER_EOF 0x02U
+#define UVC_HEADER_PTS 0x04U
+#define UVC_HEADER_SCR 0x08U
+#define UVC_HEADER_STI 0x20U
+#define UVC_HEADER_EOH 0x80U
+
+#define UVC_HEADER_PTS_OFFSET 2U
+#define UVC_HEADER_STC_OFFSET 6U
+#define UVC_HEADER_SOF_OFFSET 10U
+
+/*
+ * Frame pump
+ *
+ * Chunk buffers in internal RAM are filled from the frame in FPGA SRAM by
+ * QSPI DMA (VS_ReadFrame callback, completed with USBD_CAMERA_VS_ChunkFilled)
+ * while the previous chunk is being sent on the UVC endpoint.
+ * Buffers are used as a ring: fill_idx walks ahead of send_idx.
+ *
+ * Compressed frames have variable size: frame_size starts as the largest
+ * possible one and is cut to the real size when the chunk with the end of
+ * the frame is reported by USBD_CAMERA_VS_ChunkFilledSize.
+ *
+ * First payload of each frame has CAMERA_UVC_METADATA_LEN bytes of frame
+ * metadata from application after the standard header, bHeaderLength
+ * covers them. PTS and metadata are latched when the first chunk is read.
+ *
+ * Still image (method 2): trigger starts one exposure in application and
+ * pauses video frames. When the application reports readout is done, the
+ * still frame is sent right away with STI bit and still commit format,
+ * then video continues with its committed format.
+ *
+ * Zero-copy (bulk with OTG DMA): only the first packet of a payload, the
+ * header and the start of data, is read into the chunk buffer. The rest
+ * is sent as a second transmit of the same transfer, OTG DMA reads it
+ * from memory-mapped SRAM (VS_MapFrame). SRAM is mapped (VS_SetMapped)
+ * only while that transmit runs, a busy QSPI is tried again on next SOF.
+ * First payload of a frame is always read, the frame is picked by that
+ * read. Isochronous payloads are not split: buffer DMA sends one
+ * contiguous buffer per microframe.
+ *
+ * Everything here runs from OTG_HS and QSPI DMA interrupts, which have
+ * the same priority, so they never preempt each other.
+ */
+
+enum uvc_still_state_e {
+    UVC_STILL_NONE = 0,
+    UVC_STILL_EXPOSING,     // triggered, waiting for readout
+    UVC_STILL_SENDING,
+};
+
+enum uvc_chunk_state_e {
+    UVC_CHUNK_FREE = 0,
+    UVC_CHUNK_FILLING,
+    UVC_CHUNK_READY,
+    UVC_CHUNK_SENDING,
+#if CAMERA_UVC_ZERO_COPY
+    UVC_CHUNK_BODY_WAIT,        // first packet is sent, waiting for mapped SRAM
+    UVC_CHUNK_SENDING_BODY,
+#endif
+};
+
+struct uvc_chunk_s {
+    uint8_t data[UVC_HEADER_LEN + UVC_CHUNK];
+    size_t len;
+    uint8_t header_len;     // with metadata in the first chunk of frame
+    bool first;             // chunk starts a frame
+    enum uvc_chunk_state_e state;
+#if CAMERA_UVC_ZERO_COPY
+    const uint8_t *body;    // end of the payload in memory-mapped SRAM
+    size_t body_len;        // part of len which is not in data
+#endif
+};
+
+__ALIGN_BEGIN static struct uvc_chunk_s chunks[UVC_NUM_BUFFERS] __ALIGN_END;
+
+static struct {
+    bool streaming;
+    bool ep_busy;
+    unsigned fill_idx;
+    unsigned send_idx;
+    uint32_t fill_offset;
+    uint32_t frame_size;
+    uint32_t max_frame_size;
+    uint32_t payload_size;
+    uint32_t frame_uframes;     // committed frame interval, microframes
+    uint32_t frame_start;       // uframes when current frame was started
+    uint32_t uframes;           // SOF counter
+    uint8_t fid;
+    uint32_t pts;           // exposure start of the frame being sent
+    bool pts_valid;
+    uint8_t format_index;   // committed video format and frame
+    uint8_t frame_index;
+    enum uvc_still_state_e still;
+    bool still_frame;       // frame being filled is still image
+#if CAMERA_UVC_ZERO_COPY
+    bool mapped;            // SRAM is memory-mapped for a payload body
+#endif
+} pump;
+
+// readout of the still image is done, reported by application
+static volatile bool still_ready;
+
+// exposure start of the next frame, reported by application
+static volatile struct {
+    uint32_t pts;
+    bool valid;
+} next_pts;
+
+// metadata of the next frame, reported by application with PTS
+static uint8_t next_metadata[CAMERA_UVC_METADATA_LEN];
+
+static void uvc_apply_format(struct _USBD_HandleTypeDef *pdev, uint8_t format_index, uint8_t frame_index)
+{
+    struct USBD_CAMERA_callbacks_t *cbs = (struct USBD_CAMERA_callbacks_t *)(pdev->pUserData[USBD_CAMERA_handle.classId]);
+    if (camera_format_bits(format_index) == 0)
+        format_index = 0x01U;
+    if (camera_frame_binning(frame_index) == 0)
+        frame_index = 0x01U;
+
+    pump.frame_size = VS_FrameSize(format_index, frame_index);
+    pump.max_frame_size = pump.frame_size;
+    if (cbs != NULL && cbs->VS_SetBinning != NULL)
+        cbs->VS_SetBinning(camera_frame_binning(frame_index));
+    if (cbs != NULL && cbs->VS_SetPacking != NULL)
+        cbs->VS_SetPacking(camera_format_bits(format_index));
+    if (cbs != NULL && cbs->VS_SetCompression != NULL)
+        cbs->VS_SetCompression(camera_format_compressed(format_index));
+}
 
-static unsigned chunk_id;
-static size_t payload_size;
-static size_t frame_size = 640*480*2;
+static void uvc_still_done(struct _USBD_HandleTypeDef *pdev)
+{
+    struct USBD_CAMERA_callbacks_t *cbs = (struct USBD_CAMERA_callbacks_t *)(pdev->pUserData[USBD_CAMERA_handle.classId]);
+    pump.still_frame = false;
+    pump.still = UVC_STILL_NONE;
+    vs_state.still_trigger = UVC_TRIGGER_NORMAL;
+    uvc_apply_format(pdev, pump.format_index, pump.frame_index);
+    if (cbs != NULL && cbs->VS_StillDone != NULL)
+        cbs->VS_StillDone();
+}
 
-static void start_uvc_frame(struct _USBD_HandleTypeDef *pdev)
+static void uvc_fill_next(struct _USBD_HandleTypeDef *pdev)
 {
-    if (status != UVC_FRAME_READY)
+    struct USBD_CAMERA_callbacks_t *cbs = (struct USBD_CAMERA_callbacks_t *)(pdev->pUserData[USBD_CAMERA_handle.classId]);
+    struct uvc_chunk_s *chunk = &chunks[pump.fill_idx];
+
+    if (!pump.streaming || chunk->state != UVC_CHUNK_FREE)
+        return;
+    if (cbs == NULL || cbs->VS_ReadFrame == NULL)
         return;
 
-    offset = 0;
-    status = UVC_FRAME_RUN;
+    if (pump.fill_offset >= pump.frame_size) {
+        if (pump.still_frame)
+            uvc_still_done(pdev);
+
+        if (pump.still == UVC_STILL_EXPOSING) {
+            // video is paused while still image is exposed, then it goes right away
+            if (!still_ready)
+                return;
+            still_ready = false;
+            pump.still = UVC_STILL_SENDING;
+            pump.still_frame = true;
+            uvc_apply_format(pdev, video_Still_Commit_Control[UVC_STILL_FORMAT_INDEX],
+                             video_Still_Commit_Control[UVC_STILL_FRAME_INDEX]);
+        } else if (pump.uframes - pump.frame_start < pump.frame_uframes) {
+            // next frame is not started before committed frame interval passes
+            return;
+        }
+        pump.fill_offset = 0;
+        pump.frame_size = pump.max_frame_size;
+        pump.fid ^= UVC_HEADER_FID;
+    }
+
+    if (pump.fill_offset == 0)
+        pump.frame_start = pump.uframes;
 
-    chunk_id = 0;
-    UVC_FID = 0x01U;
-    frame[1] = UVC_FID;
+    chunk->first = pump.fill_offset == 0;
+    chunk->header_len = UVC_HEADER_LEN;
+    if (chunk->first)
+        chunk->header_len += CAMERA_UVC_METADATA_LEN;
+    size_t len = MIN(pump.payload_size - chunk->header_len, pump.frame_size - pump.fill_offset);
+    chunk->data[0] = chunk->header_len;
+    chunk->data[1] = pump.fid | UVC_HEADER_EOH;
+    if (pump.still_frame)
+        chunk->data[1] |= UVC_HEADER_STI;
+    if (pump.fill_offset + len >= pump.frame_size)
+        chunk->data[1] |= UVC_HEADER_EOF;
+    chunk->len = len;
+    chunk->state = UVC_CHUNK_FILLING;
 
-    frame[12] = 0xFFU;
-    frame[13] = 0xFFU;
-    frame[14] = 0xFFU;
-    frame[15] = 0xFFU;
+    size_t read_len = len;
+#if CAMERA_UVC_ZERO_COPY
+    chunk->body_len = 0;
+    size_t head = CAMERA_UVC_EPIN_SIZE - chunk->header_len;
+    if (!chunk->first && len > head && cbs->VS_MapFrame != NULL && cbs->VS_SetMapped != NULL) {
+        const uint8_t *body;
+        if (cbs->VS_MapFrame(pump.fill_offset + head, len - head, &body) == USBD_OK &&
+            ((uint32_t)body & 3U) == 0) {
+            chunk->body = body;
+            chunk->body_len = len - head;
+            read_len = head;
+        }
+    }
+#endif
 
-    uint8_t result = USBD_LL_Transmit(pdev, CAMERA_UVC_EPIN, frame, 12U);
-    status = UVC_FRAME_RUN;
-    chunk_id += 1;
+    // advance before reading, read may complete synchronously
+    uint32_t offset = pump.fill_offset;
+    pump.fill_offset += len;
+    if (cbs->VS_ReadFrame(offset, chunk->data + chunk->header_len, read_len) != USBD_OK) {
+        // SRAM is busy, retry on next SOF
+        chunk->state = UVC_CHUNK_FREE;
+        pump.fill_offset = offset;
+        return;
+    }
 }
 
-static void continue_uvc_frame(struct _USBD_HandleTypeDef *pdev)
+static void uvc_send_next(struct _USBD_HandleTypeDef *pdev)
 {
-    if (status != UVC_FRAME_RUN && status != UVC_FRAME_NEXT)
+    struct USBD_CAMERA_callbacks_t *cbs = (struct USBD_CAMERA_callbacks_t *)(pdev->pUserData[USBD_CAMERA_handle.classId]);
+    struct uvc_chunk_s *chunk = &chunks[pump.send_idx];
+
+    if (!pump.streaming || pump.ep_busy || chunk->state != UVC_CHUNK_READY)
         return;
 
-    if (status == UVC_FRAME_NEXT) {
-        status = UVC_FRAME_RUN;
-        UVC_FID ^= 0x01U;
-        offset = 0;
+    // SCR: device clock and USB frame number when payload goes out
+    uint32_t stc;
+    if (cbs != NULL && cbs->VS_GetTimestamp != NULL && cbs->VS_GetTimestamp(&stc) == USBD_OK) {
+        uint16_t sof = USBD_LL_GetFrameNumber(pdev);
+        put_u32(&chunk->data[UVC_HEADER_STC_OFFSET], stc);
+        chunk->data[UVC_HEADER_SOF_OFFSET] = LOBYTE(sof);
+        chunk->data[UVC_HEADER_SOF_OFFSET + 1] = HIBYTE(sof);
+        chunk->data[1] |= UVC_HEADER_SCR;
+    } else {
+        chunk->data[1] &= ~UVC_HEADER_SCR;
     }
 
-    if (frame_size - offset > UVC_CHUNK) {
-        frame[1] = UVC_FID;
-        payload_size = UVC_CHUNK;
-    } else {
-        frame[1] = UVC_FID | 0x02;
-        payload_size = frame_size - offset;
-        status = UVC_FRAME_NEXT;
+    size_t len = chunk->len;
+#if CAMERA_UVC_ZERO_COPY
+    len -= chunk->body_len;
+#endif
+    chunk->state = UVC_CHUNK_SENDING;
+    pump.ep_busy = true;
+    USBD_LL_Transmit(pdev, CAMERA_UVC_EPIN, chunk->data, len + chunk->header_len);
+}
+
+#if CAMERA_UVC_ZERO_COPY
+static void uvc_send_body(struct _USBD_HandleTypeDef *pdev)
+{
+    struct USBD_CAMERA_callbacks_t *cbs = (struct USBD_CAMERA_callbacks_t *)(pdev->pUserData[USBD_CAMERA_handle.classId]);
+    struct uvc_chunk_s *chunk = &chunks[pump.send_idx];
+
+    if (!pump.streaming || chunk->state != UVC_CHUNK_BODY_WAIT)
+        return;
+    if (!pump.mapped) {
+        // chunk read in progress, retry on next SOF
+        if (cbs->VS_SetMapped(true) != USBD_OK)
+            return;
+        pump.mapped = true;
+    }
+    chunk->state = UVC_CHUNK_SENDING_BODY;
+    USBD_LL_Transmit(pdev, CAMERA_UVC_EPIN, (uint8_t *)chunk->body, chunk->body_len);
+}
+
+/* Give SRAM back to indirect reads, endpoint does not read the body anymore */
+static void uvc_unmap(struct _USBD_HandleTypeDef *pdev)
+{
+    struct USBD_CAMERA_callbacks_t *cbs = (struct USBD_CAMERA_callbacks_t *)(pdev->pUserData[USBD_CAMERA_handle.classId]);
+    if (!pump.mapped || cbs == NULL)
+        return;
+    cbs->VS_SetMapped(false);
+    pump.mapped = false;
+}
+#endif
+
+static void uvc_stream_start(struct _USBD_HandleTypeDef *pdev, uint8_t alt)
+{
+    unsigned i;
+    for (i = 0; i < UVC_NUM_BUFFERS; i++)
+        chunks[i].state = UVC_CHUNK_FREE;
+
+    pump.fill_idx = 0;
+    pump.send_idx = 0;
+    // stream with parameters committed by host
+    pump.format_index = video_Commit_Control[UVC_PROBE_FORMAT_INDEX];
+    pump.frame_index = video_Commit_Control[UVC_PROBE_FRAME_INDEX];
+    uvc_apply_format(pdev, pump.format_index, pump.frame_index);
+
+    if (pump.still_frame) {
+        // still image was interrupted, frame is still in SRAM, send it again
+        pump.still_frame = false;
+        pump.still = UVC_STILL_EXPOSING;
+        still_ready = true;
+    }
+    // with still image pending, start from frame boundary
+    pump.fill_offset = pump.still == UVC_STILL_EXPOSING ? pump.frame_size : 0;
+
+    pump.payload_size = camera_alt_payload_size(alt);
+    uint32_t committed_payload = get_u32(&video_Commit_Control[UVC_PROBE_MAX_PAYLOAD_SIZE]);
+    if (committed_payload > UVC_HEADER_LEN && committed_payload < pump.payload_size)
+        pump.payload_size = committed_payload;
+
+    pump.frame_uframes = get_u32(&video_Commit_Control[UVC_PROBE_FRAME_INTERVAL]) / UVC_MICROFRAME_INTERVAL;
+    pump.uframes = 0;
+    pump.frame_start = 0;
+    pump.fid = 0x00U;
+    pump.ep_busy = false;
+    pump.streaming = true;
+
+    uvc_fill_next(pdev);
+}
+
+static void uvc_stream_stop(struct _USBD_HandleTypeDef *pdev)
+{
+    pump.streaming = false;
+    pump.ep_busy = false;
+}
+
+/* Start still image capture, by host trigger control */
+static uint8_t VS_StillStart(struct _USBD_HandleTypeDef *pdev)
+{
+    struct USBD_CAMERA_callbacks_t *cbs = (struct USBD_CAMERA_callbacks_t *)(pdev->pUserData[USBD_CAMERA_handle.classId]);
+    if (pump.still != UVC_STILL_NONE)
+        return USBD_BUSY;
+    if (cbs == NULL || cbs->VS_StillTrigger == NULL)
+        return USBD_FAIL;
+
+    still_ready = false;
+    pump.still = UVC_STILL_EXPOSING;
+    vs_state.still_trigger = UVC_TRIGGER_TRANSMIT;
+    if (cbs->VS_StillTrigger() != USBD_OK) {
+        pump.still = UVC_STILL_NONE;
+        vs_state.still_trigger = UVC_TRIGGER_NORMAL;
+        return USBD_FAIL;
+    }
+    return USBD_OK;
+}
+
+uint8_t USBD_CAMERA_VS_StillReady(USBD_HandleTypeDef *pdev)
+{
+    // still image was aborted
+    if (pump.still != UVC_STILL_EXPOSING)
+        return USBD_FAIL;
+    still_ready = true;
+    return USBD_OK;
+}
+
+static void VS_StillTriggerControl(struct _USBD_HandleTypeDef *pdev, uint8_t trigger)
+{
+    switch (trigger)
+    {
+    case UVC_TRIGGER_TRANSMIT:
+    case UVC_TRIGGER_TRANSMIT_BULK:
+        // no dedicated still endpoint, both go on video endpoint
+        VS_StillStart(pdev);
+        break;
+    case UVC_TRIGGER_ABORT:
+        // frame which is being sent is finished, not started one is dropped
+        if (pump.still == UVC_STILL_EXPOSING) {
+            pump.still = UVC_STILL_NONE;
+            still_ready = false;
+            vs_state.still_trigger = UVC_TRIGGER_NORMAL;
+        }
+        break;
+    default:
+        break;
     }
-    uint8_t result = USBD_LL_Transmit(pdev, CAMERA_UVC_EPIN, frame, payload_size + 12U);
-    offset += payload_size;
-    chunk_id += 1;
+}
+
+uint8_t USBD_CAMERA_VS_SetPTS(USBD_HandleTypeDef *pdev, uint32_t pts)
+{
+    next_pts.pts = pts;
+    next_pts.valid = true;
+    return USBD_OK;
+}
+
+/* Metadata goes with the frame for which PTS is set next, see USBD_CAMERA_VS_SetPTS */
+uint8_t USBD_CAMERA_VS_SetMetadata(USBD_HandleTypeDef *pdev, const uint8_t *metadata)
+{
+    memcpy(next_metadata, metadata, CAMERA_UVC_METADATA_LEN);
+    return USBD_OK;
+}
+
+uint8_t USBD_CAMERA_VS_ChunkFilled(USBD_HandleTypeDef *pdev, bool ok)
+{
+    struct uvc_chunk_s *chunk = &chunks[pump.fill_idx];
+
+    if (chunk->state != UVC_CHUNK_FILLING)
+        return USBD_FAIL;
+
+    if (!pump.streaming) {
+        chunk->state = UVC_CHUNK_FREE;
+        return USBD_OK;
+    }
+
+    if (!ok) {
+        // read the same chunk again
+        chunk->state = UVC_CHUNK_FREE;
+        pump.fill_offset -= chunk->len;
+        uvc_fill_next(pdev);
+        return USBD_FAIL;
+    }
+
+    if (chunk->first) {
+        // PTS is the same for all payloads of the frame. It is taken when the
+        // first chunk is read, application may pick the frame on that read
+        pump.pts_valid = next_pts.valid;
+        pump.pts = next_pts.pts;
+        memcpy(&chunk->data[UVC_HEADER_LEN], next_metadata, CAMERA_UVC_METADATA_LEN);
+    }
+    if (pump.pts_valid)
+        chunk->data[1] |= UVC_HEADER_PTS;
+    put_u32(&chunk->data[UVC_HEADER_PTS_OFFSET], pump.pts);
+
+    chunk->state = UVC_CHUNK_READY;
+    pump.fill_idx = (pump.fill_idx + 1U) % UVC_NUM_BUFFERS;
+
+    uvc_send_next(pdev);
+    uvc_fill_next(pdev);
+    return USBD_OK;
+}
+
+uint8_t USBD_CAMERA_VS_ChunkFilledSize(USBD_HandleTypeDef *pdev, size_t len, bool eof)
+{
+    struct uvc_chunk_s *chunk = &chunks[pump.fill_idx];
+
+    if (chunk->state != UVC_CHUNK_FILLING || len > chunk->len)
+        return USBD_FAIL;
+
+    // give back the part of the chunk which was not filled
+    pump.fill_offset -= chunk->len - len;
+    chunk->len = len;
+    if (eof) {
+        chunk->data[1] |= UVC_HEADER_EOF;
+        pump.frame_size = pump.fill_offset;
+    }
+    return USBD_CAMERA_VS_ChunkFilled(pdev, true);
 }
 
 uint8_t VS_DataIn(struct _USBD_HandleTypeDef *pdev, uint8_t epnum)
 {
-    if (USBD_CAMERA_handle.VS_alt == 0)
+    if (!pump.streaming)
+        return USBD_OK;
+
+    struct uvc_chunk_s *chunk = &chunks[pump.send_idx];
+#if CAMERA_UVC_ZERO_COPY
+    if (chunk->state == UVC_CHUNK_SENDING && chunk->body_len > 0) {
+        // first packet is out, rest of the payload goes from SRAM
+        chunk->state = UVC_CHUNK_BODY_WAIT;
+        uvc_send_body(pdev);
         return USBD_OK;
-    continue_uvc_frame(pdev);
+    }
+    if (chunk->state == UVC_CHUNK_SENDING_BODY) {
+        uvc_unmap(pdev);
+        chunk->state = UVC_CHUNK_SENDING;
+    }
+#endif
+    if (chunk->state == UVC_CHUNK_SENDING) {
+        chunk->state = UVC_CHUNK_FREE;
+        pump.send_idx = (pump.send_idx + 1U) % UVC_NUM_BUFFERS;
+#if CAMERA_UVC_BULK
+        // host detects end of a shorter payload only by short packet
+        size_t sent = chunk->len + chunk->header_len;
+        if (sent < pump.payload_size && sent % CAMERA_UVC_EPIN_SIZE == 0) {
+            USBD_LL_Transmit(pdev, CAMERA_UVC_EPIN, NULL, 0);
+            uvc_fill_next(pdev);
+            return USBD_OK;
+        }
+#endif
+    }
+    pump.ep_busy = false;
+
+    uvc_send_next(pdev);
+    uvc_fill_next(pdev);
     return USBD_OK;
 }
 
@@ -184,7 +864,9 @@ uint8_t VS_IsoINIncomplete(struct _USBD_HandleTypeDef *pdev, uint8_t epnum)
     if (USBD_CAMERA_handle.VS_alt == 0)
         return USBD_OK;
 
-    uint8_t result = USBD_LL_Transmit(pdev, CAMERA_UVC_EPIN, frame, payload_size + 12U);
+    struct uvc_chunk_s *chunk = &chunks[pump.send_idx];
+    if (chunk->state == UVC_CHUNK_SENDING)
+        USBD_LL_Transmit(pdev, CAMERA_UVC_EPIN, chunk->data, chunk->len + chunk->header_len);
     return USBD_OK;
 }
 
@@ -194,33 +876,109 @@ static uint8_t VS_SetInterface(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTy
         return USBD_OK;
 
     uint8_t old_alt = USBD_CAMERA_handle.VS_alt;
-    int newAlt = LOBYTE(req->wValue);
-    if (newAlt != 0 && newAlt != 1)
+    unsigned newAlt = LOBYTE(req->wValue);
+    if (newAlt > CAMERA_UVC_NUM_ALTS)
         return USBD_FAIL;
     USBD_CAMERA_handle.VS_alt = newAlt;
 
     if (old_alt != USBD_CAMERA_handle.VS_alt)
     {
         struct USBD_CAMERA_callbacks_t *cbs = (struct USBD_CAMERA_callbacks_t *)(pdev->pUserData[USBD_CAMERA_handle.classId]);
-        if (USBD_CAMERA_handle.VS_alt == 1)
+        if (old_alt != 0)
+        {
+            // host switched to another bandwidth or stopped stream
+            uvc_stream_stop(pdev);
+            close_isoc_ep(pdev);
+        }
+
+        if (USBD_CAMERA_handle.VS_alt != 0)
         {
-            open_isoc_ep(pdev);
-            status = UVC_FRAME_READY;
+            open_isoc_ep(pdev, USBD_CAMERA_handle.VS_alt);
             USBD_LL_FlushEP(pdev, CAMERA_UVC_EPIN);
-            if (cbs->VS_StartStream != NULL)
-                return cbs->VS_StartStream();
+            uvc_stream_start(pdev, USBD_CAMERA_handle.VS_alt);
+            // alternate setting is switched already, request is not failed
+            if (old_alt == 0 && cbs->VS_StartStream != NULL)
+                cbs->VS_StartStream();
         }
         else
         {
-            close_isoc_ep(pdev);
             if (cbs->VS_StopStream != NULL)
-                return cbs->VS_StopStream();
+                cbs->VS_StopStream();
         }
     }
 
     return USBD_OK;
 }
 
+#if CAMERA_UVC_BULK
+/*
+ * Bulk endpoint belongs to alt 0, so stream is started by COMMIT
+ * and stopped by CLEAR_FEATURE(ENDPOINT_HALT) on the endpoint
+ */
+static uint8_t VS_BulkStart(struct _USBD_HandleTypeDef *pdev)
+{
+    struct USBD_CAMERA_callbacks_t *cbs = (struct USBD_CAMERA_callbacks_t *)(pdev->pUserData[USBD_CAMERA_handle.classId]);
+    bool restart = pump.streaming;
+    if (restart) {
+        uvc_stream_stop(pdev);
+        USBD_LL_FlushEP(pdev, CAMERA_UVC_EPIN);
+#if CAMERA_UVC_ZERO_COPY
+        uvc_unmap(pdev);
+#endif
+    }
+
+    uvc_stream_start(pdev, 0);
+    if (!restart && cbs->VS_StartStream != NULL)
+        return cbs->VS_StartStream();
+    return USBD_OK;
+}
+
+static uint8_t VS_BulkStop(struct _USBD_HandleTypeDef *pdev)
+{
+    struct USBD_CAMERA_callbacks_t *cbs = (struct USBD_CAMERA_callbacks_t *)(pdev->pUserData[USBD_CAMERA_handle.classId]);
+    if (!pump.streaming)
+        return USBD_OK;
+
+    uvc_stream_stop(pdev);
+    USBD_LL_FlushEP(pdev, CAMERA_UVC_EPIN);
+#if CAMERA_UVC_ZERO_COPY
+    uvc_unmap(pdev);
+#endif
+    if (cbs->VS_StopStream != NULL)
+        return cbs->VS_StopStream();
+    return USBD_OK;
+}
+#endif
+
+static void VS_ClearFeature(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+    // status stage is already sent by core
+    if ((req->bmRequest & USB_REQ_RECIPIENT_MASK) != USB_REQ_RECIPIENT_ENDPOINT)
+        return;
+    if (req->wValue != USB_FEATURE_EP_HALT || LOBYTE(req->wIndex) != CAMERA_UVC_EPIN)
+        return;
+#if CAMERA_UVC_BULK
+    VS_BulkStop(pdev);
+#endif
+}
+
+void VS_Init(struct _USBD_HandleTypeDef *pdev)
+{
+    USBD_CAMERA_handle.VS_alt = 0x00U;
+    uvc_stream_stop(pdev);
+#if CAMERA_UVC_ZERO_COPY
+    uvc_unmap(pdev);
+#endif
+    pump.still = UVC_STILL_NONE;
+    pump.still_frame = false;
+    vs_state.still_trigger = UVC_TRIGGER_NORMAL;
+#if CAMERA_UVC_BULK
+    USBD_LL_OpenEP(pdev, CAMERA_UVC_EPIN, USBD_EP_TYPE_BULK, CAMERA_UVC_EPIN_SIZE);
+    pdev->ep_in[CAMERA_UVC_EPIN & 0x0FU].maxpacket = CAMERA_UVC_EPIN_SIZE;
+    pdev->ep_in[CAMERA_UVC_EPIN & 0x0FU].is_used = 1U;
+#endif
+}
+
 static void VS_GetStatus(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
 {
     if (pdev->dev_state == USBD_STATE_CONFIGURED)
@@ -232,10 +990,47 @@ static void VS_GetStatus(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef
     }
 }
 
+uint8_t VS_EP0_RxReady(struct _USBD_HandleTypeDef *pdev)
+{
+    switch (vs_state.set_cur_selector)
+    {
+    case VS_PROBE_CONTROL_SELECTOR:
+        VS_Negotiate(video_Probe_Control);
+        break;
+    case VS_COMMIT_CONTROL_SELECTOR:
+        VS_Negotiate(vs_state.set_cur_buf);
+        memcpy(video_Commit_Control, vs_state.set_cur_buf, UVC_CONTROL_LEN);
+#if CAMERA_UVC_BULK
+        vs_state.set_cur_selector = 0;
+        return VS_BulkStart(pdev);
+#endif
+        break;
+    case VS_STILL_PROBE_CONTROL_SELECTOR:
+        VS_NegotiateStill(video_Still_Probe_Control);
+        break;
+    case VS_STILL_COMMIT_CONTROL_SELECTOR:
+        VS_NegotiateStill(vs_state.set_cur_buf);
+        memcpy(video_Still_Commit_Control, vs_state.set_cur_buf, UVC_STILL_CONTROL_LEN);
+        break;
+    case VS_STILL_IMAGE_TRIGGER_CONTROL_SELECTOR:
+        VS_StillTriggerControl(pdev, vs_state.set_cur_buf[0]);
+        break;
+    default:
+        break;
+    }
+    vs_state.set_cur_selector = 0;
+    return USBD_OK;
+}
+
 uint8_t VS_SOF(struct _USBD_HandleTypeDef *pdev)
 {
-    if (status == UVC_FRAME_READY) {
-        start_uvc_frame(pdev);
+    if (pump.streaming) {
+        pump.uframes++;
+#if CAMERA_UVC_ZERO_COPY
+        uvc_send_body(pdev);
+#endif
+        uvc_fill_next(pdev);
+        uvc_send_next(pdev);
     }
     return USBD_OK;
 }
@@ -261,7 +1056,12 @@ void VS_Setup(struct _USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
             VS_GetInterface(pdev, req);
             break;
         case USB_REQ_SET_INTERFACE:
-            VS_SetInterface(pdev, req);
+            // alternate setting which does not exist
+            if (VS_SetInterface(pdev, req) != USBD_OK)
+                USBD_CtlError(pdev, req);
+            break;
+        case USB_REQ_CLEAR_FEATURE:
+            VS_ClearFeature(pdev, req);
             break;
         default:
             break;
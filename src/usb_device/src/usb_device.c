@@ -1,6 +1,7 @@
 #include "usb_device.h"
 #include "usbd_core.h"
 #include <stdint.h>
+#include <stddef.h>
 
 #include "stm32f4xx_hal_pcd.h"
 #include "camera.h"
@@ -12,9 +13,23 @@ static struct usb_context_s usb_context;
 extern USBD_DescriptorsTypeDef USB_Descriptors;
 
 extern PCD_HandleTypeDef hpcd_USB_OTG_HS;
+
+// time spent in OTG interrupt, for load benchmark
+static volatile uint32_t irq_cycles;
+static volatile uint32_t irq_count;
+
 void OTG_HS_IRQHandler(void)
 {
+    uint32_t start = DWT->CYCCNT;
     HAL_PCD_IRQHandler(&hpcd_USB_OTG_HS);
+    irq_cycles += DWT->CYCCNT - start;
+    irq_count++;
+}
+
+void USB_DEVICE_GetIrqLoad(uint32_t *cycles, uint32_t *count)
+{
+    *cycles = irq_cycles;
+    *count = irq_count;
 }
 
 #define UNSIGNED16(low, high) ((((unsigned)(high)) << 8) | (low))
@@ -22,14 +37,119 @@ void OTG_HS_IRQHandler(void)
 
 static uint8_t VS_StartStream(void)
 {
+    if (usb_context.start_stream != NULL)
+        return usb_context.start_stream();
     return USBD_OK;
 }
 
 static uint8_t VS_StopStream(void)
 {
+    if (usb_context.stop_stream != NULL)
+        return usb_context.stop_stream();
+    return USBD_OK;
+}
+
+static uint8_t VS_ReadFrame(uint32_t offset, uint8_t *buf, size_t len)
+{
+    if (usb_context.read_frame != NULL)
+        return usb_context.read_frame(offset, buf, len);
+    return USBD_FAIL;
+}
+
+static uint8_t VS_MapFrame(uint32_t offset, size_t len, const uint8_t **data)
+{
+    if (usb_context.map_frame != NULL)
+        return usb_context.map_frame(offset, len, data);
+    return USBD_FAIL;
+}
+
+static uint8_t VS_SetMapped(bool mapped)
+{
+    if (usb_context.set_mapped != NULL)
+        return usb_context.set_mapped(mapped);
+    return USBD_FAIL;
+}
+
+static uint8_t RAW_StartStream(void)
+{
+    if (usb_context.raw_start != NULL)
+        return usb_context.raw_start();
+    return USBD_OK;
+}
+
+static uint8_t RAW_StopStream(void)
+{
+    if (usb_context.raw_stop != NULL)
+        return usb_context.raw_stop();
+    return USBD_OK;
+}
+
+_Static_assert(sizeof(struct raw_frame_header_s) <= CAMERA_RAW_HEADER_LEN, "raw frame header size");
+
+static uint8_t RAW_NextFrame(uint8_t *header, const uint8_t **data, uint32_t *size)
+{
+    if (usb_context.raw_next_frame != NULL)
+        return usb_context.raw_next_frame((struct raw_frame_header_s *)header, data, size);
+    return USBD_FAIL;
+}
+
+static uint8_t RAW_ResendFrame(uint8_t *header, uint32_t sequence, uint32_t offset, uint32_t length,
+                               const uint8_t **data, uint32_t *size)
+{
+    if (usb_context.raw_resend_frame != NULL)
+        return usb_context.raw_resend_frame((struct raw_frame_header_s *)header, sequence, offset, length, data, size);
+    return USBD_FAIL;
+}
+
+static uint8_t RAW_FrameDone(void)
+{
+    if (usb_context.raw_frame_done != NULL)
+        return usb_context.raw_frame_done();
     return USBD_OK;
 }
 
+static uint8_t VS_GetTimestamp(uint32_t *timestamp)
+{
+    if (usb_context.get_timestamp != NULL)
+        return usb_context.get_timestamp(timestamp);
+    return USBD_FAIL;
+}
+
+static uint8_t VS_SetBinning(unsigned binning)
+{
+    if (usb_context.set_binning != NULL)
+        return usb_context.set_binning(binning);
+    return USBD_FAIL;
+}
+
+static uint8_t VS_SetPacking(unsigned bits)
+{
+    if (usb_context.set_packing != NULL)
+        return usb_context.set_packing(bits);
+    return USBD_FAIL;
+}
+
+static uint8_t VS_SetCompression(bool compressed)
+{
+    if (usb_context.set_compression != NULL)
+        return usb_context.set_compression(compressed);
+    return USBD_FAIL;
+}
+
+static uint8_t VS_StillTrigger(void)
+{
+    if (usb_context.still_trigger != NULL)
+        return usb_context.still_trigger();
+    return USBD_FAIL;
+}
+
+static uint8_t VS_StillDone(void)
+{
+    if (usb_context.still_done != NULL)
+        return usb_context.still_done();
+    return USBD_FAIL;
+}
+
 static uint8_t VC_GetGain(unsigned *gain)
 {
     if (usb_context.get_gain != NULL)
@@ -62,6 +182,101 @@ static uint8_t VC_SetExposure(uint32_t exposure)
     return USBD_OK;
 }
 
+static uint8_t VC_GetTriggerLatency(uint32_t latency[4])
+{
+    if (usb_context.get_trigger_latency != NULL)
+        return usb_context.get_trigger_latency(latency);
+    return USBD_OK;
+}
+
+static uint8_t VC_GetFrameStats(uint32_t stats[6])
+{
+    if (usb_context.get_frame_stats != NULL)
+        return usb_context.get_frame_stats(stats);
+    return USBD_OK;
+}
+
+static uint8_t VC_GetFrameHistogram(uint32_t histogram[CAMERA_STATS_BINS])
+{
+    if (usb_context.get_frame_histogram != NULL)
+        return usb_context.get_frame_histogram(histogram);
+    return USBD_OK;
+}
+
+static uint8_t VC_SetAEMode(unsigned mode)
+{
+    if (usb_context.set_ae_mode != NULL)
+        return usb_context.set_ae_mode(mode);
+    return USBD_OK;
+}
+
+static uint8_t VC_GetAEMode(unsigned *mode)
+{
+    if (usb_context.get_ae_mode != NULL)
+        return usb_context.get_ae_mode(mode);
+    else
+        *mode = VC_AE_MODE_MANUAL;
+    return USBD_OK;
+}
+
+static uint8_t VC_SetAETarget(unsigned target, unsigned percentile)
+{
+    if (usb_context.set_ae_target != NULL)
+        return usb_context.set_ae_target(target, percentile);
+    return USBD_OK;
+}
+
+static uint8_t VC_GetAETarget(unsigned *target, unsigned *percentile)
+{
+    if (usb_context.get_ae_target != NULL)
+        return usb_context.get_ae_target(target, percentile);
+    return USBD_OK;
+}
+
+static uint8_t VC_SetGuideROIs(unsigned count, unsigned size, uint16_t centers[][2])
+{
+    if (usb_context.set_guide_rois != NULL)
+        return usb_context.set_guide_rois(count, size, centers);
+    return USBD_FAIL;
+}
+
+static uint8_t VC_GetGuideROIs(unsigned *count, unsigned *size, uint16_t centers[][2])
+{
+    if (usb_context.get_guide_rois != NULL)
+        return usb_context.get_guide_rois(count, size, centers);
+    return USBD_OK;
+}
+
+static uint8_t VC_SetStack(unsigned depth, unsigned flags, unsigned shift)
+{
+    if (usb_context.set_stack != NULL)
+        return usb_context.set_stack(depth, flags, shift);
+    return USBD_FAIL;
+}
+
+static uint8_t VC_GetStack(unsigned *depth, unsigned *flags, unsigned *shift)
+{
+    if (usb_context.get_stack != NULL)
+        return usb_context.get_stack(depth, flags, shift);
+    return USBD_OK;
+}
+
+static uint8_t VC_GetExposureUs(uint32_t *exposure)
+{
+    if (usb_context.get_exposure_us != NULL)
+        return usb_context.get_exposure_us(exposure);
+    else
+        *exposure = VC_DEFAULT_EXPOSURE * 100U;
+    return USBD_OK;
+}
+
+static uint8_t VC_SetExposureUs(uint32_t exposure)
+{
+    if (usb_context.set_exposure_us != NULL)
+        return usb_context.set_exposure_us(exposure);
+    return USBD_OK;
+}
+
 uint8_t VC_GetFan(unsigned *fan)
 {
     if (usb_context.get_fan != NULL)
@@ -176,11 +391,38 @@ static uint8_t CDC_DATA_DataOut(const uint8_t *data, size_t len)
 static struct USBD_CAMERA_callbacks_t callbacks = {
     .VS_StartStream = VS_StartStream,
     .VS_StopStream = VS_StopStream,
+    .VS_ReadFrame = VS_ReadFrame,
+    .VS_MapFrame = VS_MapFrame,
+    .VS_SetMapped = VS_SetMapped,
+    .RAW_StartStream = RAW_StartStream,
+    .RAW_StopStream = RAW_StopStream,
+    .RAW_NextFrame = RAW_NextFrame,
+    .RAW_ResendFrame = RAW_ResendFrame,
+    .RAW_FrameDone = RAW_FrameDone,
+    .VS_GetTimestamp = VS_GetTimestamp,
+    .VS_SetBinning = VS_SetBinning,
+    .VS_SetPacking = VS_SetPacking,
+    .VS_SetCompression = VS_SetCompression,
+    .VS_StillTrigger = VS_StillTrigger,
+    .VS_StillDone = VS_StillDone,
 
     .VC_GetGain = VC_GetGain,
     .VC_SetGain = VC_SetGain,
     .VC_GetExposure = VC_GetExposure,
     .VC_SetExposure = VC_SetExposure,
+    .VC_GetExposureUs = VC_GetExposureUs,
+    .VC_SetExposureUs = VC_SetExposureUs,
+    .VC_GetTriggerLatency = VC_GetTriggerLatency,
+    .VC_GetFrameStats = VC_GetFrameStats,
+    .VC_GetFrameHistogram = VC_GetFrameHistogram,
+    .VC_SetAEMode = VC_SetAEMode,
+    .VC_GetAEMode = VC_GetAEMode,
+    .VC_SetAETarget = VC_SetAETarget,
+    .VC_GetAETarget = VC_GetAETarget,
+    .VC_SetGuideROIs = VC_SetGuideROIs,
+    .VC_GetGuideROIs = VC_GetGuideROIs,
+    .VC_SetStack = VC_SetStack,
+    .VC_GetStack = VC_GetStack,
 
     .VC_GetCurrentTemperature = VC_GetCurrentTemperature,
     .VC_GetTargetTemperature = VC_GetTargetTemperature,
@@ -201,7 +443,7 @@ static struct USBD_CAMERA_callbacks_t callbacks = {
     .CDC_DATA_DataOut = CDC_DATA_DataOut,
 };
 
-struct usb_context_s* USB_DEVICE_Init(unsigned fps, unsigned width, unsigned height, const char *FourCC)
+struct usb_context_s* USB_DEVICE_Init(unsigned fps, unsigned width, unsigned height, const char *const FourCC[])
 {
     /* Reset PHY */
     HAL_GPIO_WritePin(USB_RST_GPIO_Port, USB_RST_Pin, GPIO_PIN_SET);
@@ -213,6 +455,9 @@ struct usb_context_s* USB_DEVICE_Init(unsigned fps, unsigned width, unsigned hei
     if (USBD_CAMERA_Configure(fps, width, height, FourCC) != USBD_OK)
         return NULL;
 
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
     /* Init USB */
     if (USBD_Init(&hUsbDeviceHS, &USB_Descriptors, DEVICE_HS) != USBD_OK)
         return NULL;
@@ -275,3 +520,38 @@ uint8_t send_serial_data(const uint8_t *data, size_t len)
         return USBD_OK;
     return USBD_CAMERA_CDC_DATA_SendSerial(&hUsbDeviceHS, data, len);
 }
+
+_Static_assert(sizeof(struct guide_star_s) == 16U, "guide star size");
+
+uint8_t send_guide_report(const struct guide_report_s *report, unsigned stars)
+{
+    size_t len = offsetof(struct guide_report_s, stars) + stars * sizeof(struct guide_star_s);
+    return USBD_CAMERA_GUIDE_SendReport(&hUsbDeviceHS, (const uint8_t *)report, len);
+}
+
+uint8_t frame_chunk_filled(bool ok)
+{
+    return USBD_CAMERA_VS_ChunkFilled(&hUsbDeviceHS, ok);
+}
+
+uint8_t frame_chunk_filled_size(size_t len, bool eof)
+{
+    return USBD_CAMERA_VS_ChunkFilledSize(&hUsbDeviceHS, len, eof);
+}
+
+uint8_t frame_set_pts(uint32_t pts)
+{
+    return USBD_CAMERA_VS_SetPTS(&hUsbDeviceHS, pts);
+}
+
+_Static_assert(sizeof(struct frame_metadata_s) == CAMERA_UVC_METADATA_LEN, "frame metadata size");
+
+uint8_t frame_set_metadata(const struct frame_metadata_s *metadata)
+{
+    return USBD_CAMERA_VS_SetMetadata(&hUsbDeviceHS, (const uint8_t *)metadata);
+}
+
+uint8_t frame_still_ready(void)
+{
+    return USBD_CAMERA_VS_StillReady(&hUsbDeviceHS);
+}
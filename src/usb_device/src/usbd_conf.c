@@ -16,6 +16,9 @@
   ******************************************************************************
   */
 
+#include <stdbool.h>
+#include <string.h>
+
 #include "stm32f4xx.h"
 #include "stm32f4xx_hal.h"
 #include "usbd_def.h"
@@ -24,6 +27,10 @@
 
 PCD_HandleTypeDef hpcd_USB_OTG_HS;
 
+#if USBD_HS_DMA_ENABLE
+__ALIGN_BEGIN static uint8_t ep0_tx_buf[USBD_EP0_TX_BUF_SIZE] __ALIGN_END;
+#endif
+
 /* External functions --------------------------------------------------------*/
 void PLL_Config(void);
 void SYSCLK_Config(void);
@@ -227,6 +234,20 @@ void HAL_PCD_DisconnectCallback(PCD_HandleTypeDef *hpcd)
                        LL Driver Interface (USB Device Library --> PCD)
 *******************************************************************************/
 
+/* FIFO plan of usbd_conf.h must fit OTG HS FIFO RAM */
+_Static_assert(USBD_FIFO_FIXED_WORDS < USBD_FIFO_RAM_WORDS, "USB FIFO RAM overflow");
+_Static_assert(USBD_FIFO_FIXED_WORDS + CAMERA_UVC_TXFIFO <= USBD_FIFO_RAM_WORDS, "USB FIFO RAM overflow");
+_Static_assert(USBD_EP0_TXFIFO >= 16U && CAMERA_CDC_ACM_TXFIFO >= 16U &&
+               CAMERA_CDC_DATA_TXFIFO >= 16U && CAMERA_GUIDE_TXFIFO >= 16U, "TxFIFO is less than 16 words");
+_Static_assert(CAMERA_UVC_TXFIFO >= 2U * USBD_FIFO_WORDS(CAMERA_UVC_EPIN_SIZE), "UVC TxFIFO holds less than two packets");
+#if CAMERA_RAW_ENABLE
+_Static_assert(CAMERA_RAW_BLOCK % CAMERA_RAW_EPIN_SIZE == 0 && CAMERA_RAW_BLOCK / CAMERA_RAW_EPIN_SIZE <= 1023U,
+               "raw block is not whole packets or exceeds transfer packet count");
+#endif
+#if !CAMERA_UVC_BULK
+_Static_assert(CAMERA_UVC_TXFIFO >= USBD_FIFO_WORDS(CAMERA_UVC_PAYLOAD_SIZE), "UVC TxFIFO holds less than a microframe");
+#endif
+
 /**
  * @brief  Initializes the low level portion of the device driver.
  * @param  pdev: Device handle
@@ -242,9 +263,13 @@ USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
         pdev->pData = &hpcd_USB_OTG_HS;
 
         hpcd_USB_OTG_HS.Instance = USB_OTG_HS;
-        hpcd_USB_OTG_HS.Init.dev_endpoints = 3;
+        hpcd_USB_OTG_HS.Init.dev_endpoints = 5 + CAMERA_RAW_ENABLE;
         hpcd_USB_OTG_HS.Init.speed = PCD_SPEED_HIGH;
+#if USBD_HS_DMA_ENABLE
+        hpcd_USB_OTG_HS.Init.dma_enable = ENABLE;
+#else
         hpcd_USB_OTG_HS.Init.dma_enable = DISABLE;
+#endif
         hpcd_USB_OTG_HS.Init.phy_itface = USB_OTG_ULPI_PHY;
         hpcd_USB_OTG_HS.Init.Sof_enable = ENABLE;
         hpcd_USB_OTG_HS.Init.low_power_enable = DISABLE;
@@ -270,12 +295,18 @@ USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
         HAL_PCD_RegisterIsoOutIncpltCallback(&hpcd_USB_OTG_HS, PCD_ISOOUTIncompleteCallback);
         HAL_PCD_RegisterIsoInIncpltCallback(&hpcd_USB_OTG_HS, PCD_ISOINIncompleteCallback);
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
-        HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_HS, 128U);       // EP0
-        HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, 0, 64U);     // EP80
+        // sizes are planned in usbd_conf.h
+        HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_HS, USBD_RXFIFO);                 // EP0, EP01
+        HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, 0, USBD_EP0_TXFIFO);          // EP80
 
+        // EP81 FIFO takes the rest: one high-bandwidth microframe and more, or several bulk packets
         HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, EPNUM(CAMERA_UVC_EPIN), CAMERA_UVC_TXFIFO);          // EP81
         HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, EPNUM(CAMERA_CDC_ACM_EPIN), CAMERA_CDC_ACM_TXFIFO);  // EP82
         HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, EPNUM(CAMERA_CDC_DATA_EPIN), CAMERA_CDC_DATA_TXFIFO); // EP83
+        HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, EPNUM(CAMERA_GUIDE_EPIN), CAMERA_GUIDE_TXFIFO);      // EP84
+#if CAMERA_RAW_ENABLE
+        HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, EPNUM(CAMERA_RAW_EPIN), CAMERA_RAW_TXFIFO);          // EP85
+#endif
     }
     return USBD_OK;
 }
@@ -474,6 +505,17 @@ USBD_StatusTypeDef USBD_LL_Transmit(USBD_HandleTypeDef *pdev, uint8_t ep_addr, u
     HAL_StatusTypeDef hal_status = HAL_OK;
     USBD_StatusTypeDef usb_status = USBD_OK;
 
+#if USBD_HS_DMA_ENABLE
+    // continuation of long EP0 reply points into ep0_tx_buf already
+    bool in_ep0_buf = pbuf >= ep0_tx_buf && pbuf < ep0_tx_buf + sizeof(ep0_tx_buf);
+    if ((ep_addr & 0x7FU) == 0 && size > 0 && !in_ep0_buf && size <= sizeof(ep0_tx_buf)) {
+        memcpy(ep0_tx_buf, pbuf, size);
+        pbuf = ep0_tx_buf;
+    }
+    if (((uint32_t)pbuf & 3U) != 0)
+        return USBD_FAIL;
+#endif
+
     hal_status = HAL_PCD_EP_Transmit(pdev->pData, ep_addr, pbuf, size);
 
     usb_status = USBD_Get_USB_Status(hal_status);
@@ -494,6 +536,11 @@ USBD_StatusTypeDef USBD_LL_PrepareReceive(USBD_HandleTypeDef *pdev, uint8_t ep_a
     HAL_StatusTypeDef hal_status = HAL_OK;
     USBD_StatusTypeDef usb_status = USBD_OK;
 
+#if USBD_HS_DMA_ENABLE
+    if (((uint32_t)pbuf & 3U) != 0)
+        return USBD_FAIL;
+#endif
+
     hal_status = HAL_PCD_EP_Receive(pdev->pData, ep_addr, pbuf, size);
 
     usb_status = USBD_Get_USB_Status(hal_status);
@@ -512,6 +559,23 @@ uint32_t USBD_LL_GetRxDataSize(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
     return HAL_PCD_EP_GetRxCount((PCD_HandleTypeDef *)pdev->pData, ep_addr);
 }
 
+/**
+ * @brief  Returns USB frame number of the last received SOF.
+ * @param  pdev: Device handle
+ * @retval 11-bit frame number
+ */
+uint16_t USBD_LL_GetFrameNumber(USBD_HandleTypeDef *pdev)
+{
+    PCD_HandleTypeDef *hpcd = (PCD_HandleTypeDef *)pdev->pData;
+    uint32_t USBx_BASE = (uint32_t)hpcd->Instance;
+    uint32_t fnsof = (USBx_DEVICE->DSTS & USB_OTG_DSTS_FNSOF) >> USB_OTG_DSTS_FNSOF_Pos;
+
+    // in high speed lower 3 bits are microframe number
+    if (hpcd->Init.speed == PCD_SPEED_HIGH)
+        fnsof >>= 3;
+    return (uint16_t)(fnsof & 0x7FFU);
+}
+
 /**
  * @brief  Send LPM message to user layer
  * @param  hpcd: PCD handle
@@ -1,10 +1,16 @@
 import sys
 
 FourCC = "Y16 "
+FourCC_Y12P = "Y12P"
+FourCC_Y10P = "Y10P"
+FourCC_Rice = "Y16R"
 width = 640
 height = 480
 
 FourCC = FourCC.encode('ASCII')
+FourCC_Y12P = FourCC_Y12P.encode('ASCII')
+FourCC_Y10P = FourCC_Y10P.encode('ASCII')
+FourCC_Rice = FourCC_Rice.encode('ASCII')
 block = [255]*256
 block[0] = FourCC[0]
 block[1] = FourCC[1]
@@ -14,6 +20,9 @@ block[4] = int(width / 256) % 256
 block[5] = width % 256
 block[6] = int(height / 256) % 256
 block[7] = height % 256
+block[8:12] = FourCC_Y12P
+block[12:16] = FourCC_Y10P
+block[16:20] = FourCC_Rice
 
 block = bytes(block)
 
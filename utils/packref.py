@@ -0,0 +1,73 @@
+# Reference packing of Y16 pixels into Y12P / Y10P, same layout as firmware
+#
+# packref.py selftest
+#     print CRC32 of the pattern packed by "pt" shell command
+# packref.py check <y16 frame> <packed frame> <bits>
+#     compare packed frame captured from camera with Y16 frame of same image
+
+import struct
+import sys
+import zlib
+
+PACK_TEST_PIXELS = 256
+
+def pack_y12p(pixels):
+    out = bytearray()
+    for i in range(0, len(pixels), 2):
+        p0, p1 = pixels[i], pixels[i + 1]
+        out.append(p0 >> 8)
+        out.append(p1 >> 8)
+        out.append(((p0 >> 4) & 0x0F) | (((p1 >> 4) & 0x0F) << 4))
+    return bytes(out)
+
+def pack_y10p(pixels):
+    out = bytearray()
+    for i in range(0, len(pixels), 4):
+        group = pixels[i:i + 4]
+        low = 0
+        for j, p in enumerate(group):
+            out.append(p >> 8)
+            low |= ((p >> 6) & 0x03) << (2 * j)
+        out.append(low)
+    return bytes(out)
+
+PACKERS = {12: pack_y12p, 10: pack_y10p}
+
+def test_pattern():
+    x = 1
+    pixels = []
+    for i in range(PACK_TEST_PIXELS):
+        x = (x * 1664525 + 1013904223) & 0xFFFFFFFF
+        pixels.append(x >> 16)
+    return pixels
+
+def selftest():
+    pixels = test_pattern()
+    for name, bits in (("Y12P", 12), ("Y10P", 10)):
+        packed = PACKERS[bits](pixels)
+        print("%s %u bytes crc32 %08X" % (name, len(packed), zlib.crc32(packed)))
+
+def check(y16_file, packed_file, bits):
+    with open(y16_file, "rb") as f:
+        raw = f.read()
+    with open(packed_file, "rb") as f:
+        packed = f.read()
+    pixels = struct.unpack("<%uH" % (len(raw) // 2), raw[:len(raw) // 2 * 2])
+    expected = PACKERS[bits](pixels)
+    if expected == packed:
+        print("OK")
+        return 0
+    if len(expected) != len(packed):
+        print("Size mismatch: expected %u, got %u" % (len(expected), len(packed)))
+        return 1
+    first = next(i for i in range(len(packed)) if packed[i] != expected[i])
+    print("Mismatch at byte %u" % first)
+    return 1
+
+if len(sys.argv) == 2 and sys.argv[1] == "selftest":
+    selftest()
+elif len(sys.argv) == 5 and sys.argv[1] == "check":
+    sys.exit(check(sys.argv[2], sys.argv[3], int(sys.argv[4])))
+else:
+    print("Usage: %s selftest | check <y16 frame> <packed frame> <bits>" % sys.argv[0])
+    sys.exit(1)
@@ -0,0 +1,131 @@
+# Capture of raw Y16 frames from the vendor bulk interface, protocol is
+# described in src/usb_device/src/camera_raw.c and
+# src/usb_device/include/usb_device.h (struct raw_frame_header_s)
+#
+# rawcap.py <count> <output prefix>
+#     saves <prefix>NNNN.y16 frames, prints header of each one
+#
+# rawcap.py resend <sequence> <offset> <length> <output>
+#     downloads a byte range of a frame which is still in camera SRAM,
+#     length 0 means up to the end of frame
+#
+# Needs pyusb (libusb backend)
+
+import struct
+import sys
+
+import usb.core
+import usb.util
+
+VID = 1155
+PID = 22315
+INTERFACE = 0x06
+EPIN = 0x85
+HEADER_LEN = 512
+PACKET = 512
+CHUNK = 2048 * PACKET
+
+REQ_START = 0x01
+REQ_STOP = 0x02
+REQ_RESEND = 0x03
+
+FLAG_RESENT = 0x0001
+FLAG_GONE = 0x0002
+
+MAGIC = 0x57415243
+HEADER = struct.Struct("<IHHHHHHI")
+METADATA = struct.Struct("<BBHIQIIHHHBBI")
+OFFSET = struct.Struct("<I")
+
+def vendor_request(dev, request, data=None):
+    bmRequestType = usb.util.build_request_type(usb.util.CTRL_OUT, usb.util.CTRL_TYPE_VENDOR,
+                                                usb.util.CTRL_RECIPIENT_INTERFACE)
+    dev.ctrl_transfer(bmRequestType, request, 0, INTERFACE, data)
+
+def parse_header(data):
+    magic, version, header_len, width, height, bits, flags, size = HEADER.unpack_from(data, 0)
+    if magic != MAGIC or header_len != HEADER_LEN:
+        raise ValueError("Not a raw frame header")
+    meta = METADATA.unpack_from(data, HEADER.size)
+    offset, = OFFSET.unpack_from(data, HEADER.size + METADATA.size)
+    return {
+        "version": version, "width": width, "height": height, "bits": bits, "size": size,
+        "resent": bool(flags & FLAG_RESENT), "gone": bool(flags & FLAG_GONE), "offset": offset,
+        "flags": meta[1], "gain": meta[2], "sequence": meta[3], "exposure": meta[4],
+        "temperature": meta[7] / 10.0 - 273.15, "dropped": meta[12],
+    }
+
+def read_frame(dev):
+    # one transfer per frame: header packet, size bytes of data, ZLP when it ends on a full packet
+    header = parse_header(dev.read(EPIN, HEADER_LEN, timeout=0))
+    size = header["size"]
+    data = bytearray(size)
+    received = 0
+    while received < size:
+        want = min(CHUNK, size - received)
+        chunk = dev.read(EPIN, want, timeout=0)
+        data[received:received + len(chunk)] = chunk
+        received += len(chunk)
+        # short packet ends the transfer early
+        if len(chunk) < want:
+            break
+    if received != size:
+        raise ValueError("Frame is truncated: %u of %u bytes" % (received, size))
+    if (HEADER_LEN + size) % PACKET == 0:
+        dev.read(EPIN, PACKET, timeout=0)
+    return header, data
+
+def capture(dev, count, prefix):
+    vendor_request(dev, REQ_START)
+    try:
+        for i in range(count):
+            header, pixels = read_frame(dev)
+            with open("%s%04u.y16" % (prefix, i), "wb") as f:
+                f.write(pixels)
+            print("#%u %ux%u exposure %u us gain %u %.1f C dropped %u" %
+                  (header["sequence"], header["width"], header["height"], header["exposure"],
+                   header["gain"], header["temperature"], header["dropped"]))
+    finally:
+        vendor_request(dev, REQ_STOP)
+
+def resend(dev, sequence, offset, length, output):
+    # offset must be a multiple of 4
+    vendor_request(dev, REQ_RESEND, struct.pack("<III", sequence, offset, length))
+    # frames already queued on endpoint are skipped
+    while True:
+        header, data = read_frame(dev)
+        if header["resent"]:
+            break
+    if header["gone"]:
+        print("Frame #%u is not in camera memory any more" % sequence)
+        return False
+    with open(output, "wb") as f:
+        f.write(data)
+    print("#%u bytes %u..%u" % (header["sequence"], header["offset"], header["offset"] + header["size"]))
+    return True
+
+if __name__ == "__main__":
+    if len(sys.argv) == 6 and sys.argv[1] == "resend":
+        mode = "resend"
+    elif len(sys.argv) == 3:
+        mode = "capture"
+    else:
+        print("Usage: %s <count> <output prefix>" % sys.argv[0])
+        print("       %s resend <sequence> <offset> <length> <output>" % sys.argv[0])
+        sys.exit(1)
+
+    dev = usb.core.find(idVendor=VID, idProduct=PID)
+    if dev is None:
+        print("Camera is not found")
+        sys.exit(1)
+    usb.util.claim_interface(dev, INTERFACE)
+
+    ok = True
+    try:
+        if mode == "resend":
+            ok = resend(dev, int(sys.argv[2]), int(sys.argv[3]), int(sys.argv[4]), sys.argv[5])
+        else:
+            capture(dev, int(sys.argv[1]), sys.argv[2])
+    finally:
+        usb.util.release_interface(dev, INTERFACE)
+    sys.exit(0 if ok else 1)
@@ -0,0 +1,88 @@
+# Decoder of Rice compressed Y16 frames, format is described in
+# src/application/include/frame_encoder.h
+#
+# ricedec.py <compressed frame> <width> <height> <output y16 frame>
+
+import struct
+import sys
+
+BLOCK = 32
+ESCAPE = 16
+RAW = 15
+
+class BitReader:
+    def __init__(self, data, pos=0):
+        self.data = data
+        self.pos = pos      # byte position
+        self.acc = 0
+        self.n = 0
+
+    def bits(self, n):
+        while self.n < n:
+            if self.pos >= len(self.data):
+                raise ValueError("Frame is truncated")
+            self.acc = (self.acc << 8) | self.data[self.pos]
+            self.pos += 1
+            self.n += 8
+        self.n -= n
+        val = (self.acc >> self.n) & ((1 << n) - 1)
+        self.acc &= (1 << self.n) - 1
+        return val
+
+    def unary(self, limit):
+        q = 0
+        while q < limit and self.bits(1) == 1:
+            q += 1
+        return q
+
+    def align(self):
+        # rest of the byte is padding
+        self.acc = 0
+        self.n = 0
+
+def decode_row(br, width, prev_first):
+    row = []
+    pred = prev_first
+    x = 0
+    while x < width:
+        n = min(BLOCK, width - x)
+        k = br.bits(4)
+        for i in range(n):
+            if k == RAW:
+                u = br.bits(16)
+            else:
+                q = br.unary(ESCAPE)
+                if q == ESCAPE:
+                    u = br.bits(16)
+                else:
+                    u = (q << k) | br.bits(k)
+            d = (u >> 1) ^ -(u & 1)
+            pred = (pred + d) & 0xFFFF
+            row.append(pred)
+        x += n
+    br.align()
+    return row
+
+def decode(data, width, height):
+    br = BitReader(data)
+    pixels = []
+    prev_first = 0
+    for y in range(height):
+        row = decode_row(br, width, prev_first)
+        prev_first = row[0]
+        pixels.extend(row)
+    return pixels, br.pos
+
+if __name__ == "__main__":
+    if len(sys.argv) != 5:
+        print("Usage: %s <compressed frame> <width> <height> <output y16 frame>" % sys.argv[0])
+        sys.exit(1)
+
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    width = int(sys.argv[2])
+    height = int(sys.argv[3])
+    pixels, used = decode(data, width, height)
+    with open(sys.argv[4], "wb") as f:
+        f.write(struct.pack("<%uH" % len(pixels), *pixels))
+    print("%u -> %u bytes, ratio %.2f" % (used, width * height * 2, width * height * 2 / used))